@@ -0,0 +1,71 @@
+//
+// Created on 2026/10/15.
+//
+
+#include "cpu_affinity.h"
+#include "mls_log.h"
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+static long ReadMaxFreq(int cpu) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    long freq = -1;
+    if (fscanf(file, "%ld", &freq) != 1) {
+        freq = -1;
+    }
+    fclose(file);
+    return freq;
+}
+
+std::vector<int> mls::GetBigCores() {
+    long cpu_count = sysconf(_SC_NPROCESSORS_CONF);
+    std::vector<long> freqs;
+    long min_freq = -1;
+    long max_freq = -1;
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        long freq = ReadMaxFreq(cpu);
+        freqs.push_back(freq);
+        if (freq <= 0) {
+            continue;
+        }
+        min_freq = min_freq < 0 ? freq : std::min(min_freq, freq);
+        max_freq = std::max(max_freq, freq);
+    }
+    std::vector<int> cores;
+    if (min_freq <= 0 || min_freq == max_freq) {
+        return cores;
+    }
+    for (int cpu = 0; cpu < static_cast<int>(freqs.size()); ++cpu) {
+        if (freqs[cpu] > min_freq) {
+            cores.push_back(cpu);
+        }
+    }
+    return cores;
+}
+
+mls::ScopedCpuAffinity::ScopedCpuAffinity(const std::vector<int>& cores) {
+    if (cores.empty() || sched_getaffinity(0, sizeof(previous_), &previous_) != 0) {
+        return;
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int core : cores) {
+        CPU_SET(core, &mask);
+    }
+    applied_ = sched_setaffinity(0, sizeof(mask), &mask) == 0;
+    if (!applied_) {
+        MNN_DEBUG("set cpu affinity failed");
+    }
+}
+
+mls::ScopedCpuAffinity::~ScopedCpuAffinity() {
+    if (applied_) {
+        sched_setaffinity(0, sizeof(previous_), &previous_);
+    }
+}
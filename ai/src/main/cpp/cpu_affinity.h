@@ -0,0 +1,27 @@
+//
+// Created on 2026/10/15.
+//
+
+#pragma once
+#include <sched.h>
+#include <vector>
+
+namespace mls {
+// Cores outside the slowest cluster, empty when the SoC is not heterogeneous
+// or cpufreq is not readable.
+std::vector<int> GetBigCores();
+
+// Pins the calling thread to |cores| for its lifetime. Threads spawned meanwhile
+// inherit the mask, which is how MNN's CPU worker pool ends up on the same cores.
+class ScopedCpuAffinity {
+public:
+    explicit ScopedCpuAffinity(const std::vector<int>& cores);
+    ~ScopedCpuAffinity();
+    ScopedCpuAffinity(const ScopedCpuAffinity&) = delete;
+    ScopedCpuAffinity& operator=(const ScopedCpuAffinity&) = delete;
+
+private:
+    bool applied_{false};
+    cpu_set_t previous_{};
+};
+}
@@ -0,0 +1,191 @@
+//
+// Created on 2026/10/15.
+//
+// Host benchmark for the diffusion path, drives mls::DiffusionSession on the CPU
+// backend and prints one JSON document with per-stage timings.
+//
+// diffusion_benchmark --model <dir> [--steps 10,20] [--cores 2,4] [--memory-modes 0,1]
+//                     [--repeat 3] [--warmup 1] [--seed 42] [--prompt "..."]
+//                     [--output-dir /tmp] [--output result.json] [--weight-variant int8]
+//
+
+#include "diffusion_session.h"
+#include "nlohmann/json.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace mls;
+using namespace nlohmann;
+
+namespace {
+struct BenchmarkOptions {
+    std::string model_dir;
+    std::string prompt{"a photo of an astronaut riding a horse on mars"};
+    std::string output_dir{"/tmp"};
+    std::string output_file;
+    std::string weight_variant;
+    std::vector<int> steps{20};
+    // 0 means all online cores
+    std::vector<int> cores{0};
+    std::vector<int> memory_modes{1};
+    int repeat{3};
+    int warmup{1};
+    int seed{42};
+};
+
+std::vector<int> ParseIntList(const char* value) {
+    std::vector<int> values;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            values.push_back(std::atoi(item.c_str()));
+        }
+    }
+    return values;
+}
+
+void PrintUsage(const char* program) {
+    fprintf(stderr,
+            "usage: %s --model <dir> [--steps 10,20] [--cores 2,4] [--memory-modes 0,1]\n"
+            "          [--repeat 3] [--warmup 1] [--seed 42] [--prompt text]\n"
+            "          [--output-dir /tmp] [--output result.json] [--weight-variant int8]\n",
+            program);
+}
+
+bool ParseOptions(int argc, char** argv, BenchmarkOptions* options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--model") {
+            options->model_dir = value;
+        } else if (arg == "--prompt") {
+            options->prompt = value;
+        } else if (arg == "--output-dir") {
+            options->output_dir = value;
+        } else if (arg == "--output") {
+            options->output_file = value;
+        } else if (arg == "--weight-variant") {
+            options->weight_variant = value;
+        } else if (arg == "--steps") {
+            options->steps = ParseIntList(value);
+        } else if (arg == "--cores") {
+            options->cores = ParseIntList(value);
+        } else if (arg == "--memory-modes") {
+            options->memory_modes = ParseIntList(value);
+        } else if (arg == "--repeat") {
+            options->repeat = std::atoi(value);
+        } else if (arg == "--warmup") {
+            options->warmup = std::atoi(value);
+        } else if (arg == "--seed") {
+            options->seed = std::atoi(value);
+        } else {
+            return false;
+        }
+    }
+    return !options->model_dir.empty() && !options->steps.empty() && !options->cores.empty() &&
+           !options->memory_modes.empty() && options->repeat > 0;
+}
+
+json StatsToJson(const DiffusionRunStats& stats, int64_t total_us) {
+    json result;
+    result["total_timeus"] = total_us;
+    result["load_timeus"] = stats.load_us;
+    result["text_encode_timeus"] = stats.text_encode_us;
+    result["unet_steps"] = stats.unet_steps;
+    result["unet_timeus"] = stats.unet_total_us;
+    result["unet_step_min_timeus"] = stats.step_min_us;
+    result["unet_step_avg_timeus"] = stats.step_avg_us;
+    result["unet_step_p95_timeus"] = stats.step_p95_us;
+    result["vae_decode_write_timeus"] = stats.vae_decode_write_us;
+    result["output_timeus"] = stats.output_us;
+    result["peak_rss_kb"] = stats.peak_rss_kb;
+    result["output_hash"] = stats.output_hash;
+    return result;
+}
+}
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, &options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    long online_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    json report;
+    report["model"] = options.model_dir;
+    report["weight_variant"] = options.weight_variant;
+    report["online_cores"] = online_cores;
+    // the exported models fix the output size, recorded so results stay comparable
+    report["resolution"] = "512x512";
+    json runs = json::array();
+    std::string image_path = options.output_dir + "/diffusion_benchmark.png";
+    for (int memory_mode : options.memory_modes) {
+        for (int core_count : options.cores) {
+            DiffusionSessionConfig config;
+            config.memory_mode = memory_mode;
+            config.backend = MNNForwardType::MNN_FORWARD_CPU;
+            config.deterministic = true;
+            config.weight_variant = options.weight_variant;
+            int pinned = core_count > 0 && core_count < online_cores ? core_count : 0;
+            for (int core = 0; core < pinned; ++core) {
+                config.cpu_cores.push_back(core);
+            }
+            if (pinned == 0) {
+                config.cpu_big_cores = false;
+            }
+            DiffusionStageTimer::ResetPeakRss();
+            auto init_start = std::chrono::steady_clock::now();
+            DiffusionSession session(options.model_dir, config);
+            auto init_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - init_start).count();
+            for (int steps : options.steps) {
+                json run;
+                run["memory_mode"] = memory_mode;
+                run["cores"] = pinned > 0 ? pinned : online_cores;
+                run["steps"] = steps;
+                run["session_init_timeus"] = init_us;
+                json samples = json::array();
+                for (int i = 0; i < options.warmup + options.repeat; ++i) {
+                    // each run resets the peak RSS itself
+                    auto start = std::chrono::steady_clock::now();
+                    DiffusionRunInfo run_info;
+                    bool success = session.Run(options.prompt, image_path, steps, options.seed, nullptr,
+                                               nullptr, &run_info);
+                    auto total_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start).count();
+                    if (!success) {
+                        fprintf(stderr, "diffusion run failed: mode %d cores %d steps %d\n",
+                                memory_mode, core_count, steps);
+                        return 2;
+                    }
+                    if (i >= options.warmup) {
+                        samples.push_back(StatsToJson(run_info.stats, total_us));
+                    }
+                }
+                run["samples"] = samples;
+                runs.push_back(run);
+                fprintf(stderr, "done: memory_mode %d cores %d steps %d\n", memory_mode, core_count, steps);
+            }
+        }
+    }
+    report["runs"] = runs;
+    std::string output = report.dump(2);
+    if (options.output_file.empty()) {
+        std::cout << output << std::endl;
+    } else {
+        std::ofstream(options.output_file) << output << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+//
+// Created on 2026/10/15.
+//
+
+#include "diffusion_image.h"
+#include "mls_log.h"
+#include <MNN/expr/ExprCreator.hpp>
+#include <cstdio>
+#include <cstring>
+#include <pthread.h>
+#include "cv/imgcodecs.hpp"
+
+using namespace MNN::Express;
+
+namespace {
+uint32_t ReadLe32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint16_t ReadLe16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+}
+
+bool mls::DecodeBmpToRgba(const std::vector<uint8_t>& bmp, DiffusionImage* image) {
+    constexpr size_t kHeaderSize = 54;
+    if (bmp.size() < kHeaderSize || bmp[0] != 'B' || bmp[1] != 'M') {
+        return false;
+    }
+    uint32_t data_offset = ReadLe32(&bmp[10]);
+    auto width = static_cast<int32_t>(ReadLe32(&bmp[18]));
+    auto height = static_cast<int32_t>(ReadLe32(&bmp[22]));
+    uint16_t bits = ReadLe16(&bmp[28]);
+    uint32_t compression = ReadLe32(&bmp[30]);
+    if (width <= 0 || height == 0 || (bits != 24 && bits != 32) || compression != 0) {
+        return false;
+    }
+    // positive height means the rows are stored bottom up
+    bool bottom_up = height > 0;
+    int rows = bottom_up ? height : -height;
+    size_t src_channels = bits / 8;
+    size_t stride = (static_cast<size_t>(width) * src_channels + 3) & ~static_cast<size_t>(3);
+    if (data_offset + stride * rows > bmp.size()) {
+        return false;
+    }
+    size_t required = static_cast<size_t>(width) * rows * 4;
+    if (!image->pixels || image->capacity < required) {
+        MNN_DEBUG("diffusion image buffer too small, required: %zu capacity: %zu", required, image->capacity);
+        return false;
+    }
+    for (int y = 0; y < rows; ++y) {
+        const uint8_t* src = &bmp[data_offset + stride * (bottom_up ? rows - 1 - y : y)];
+        uint8_t* dst = image->pixels + static_cast<size_t>(y) * width * 4;
+        for (int x = 0; x < width; ++x) {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+            dst[3] = 255;
+            src += src_channels;
+            dst += 4;
+        }
+    }
+    image->width = width;
+    image->height = rows;
+    return true;
+}
+
+mls::DiffusionImageEncoder::DiffusionImageEncoder() {
+    worker_ = std::thread(&DiffusionImageEncoder::WorkerLoop, this);
+}
+
+mls::DiffusionImageEncoder::~DiffusionImageEncoder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+void mls::DiffusionImageEncoder::Enqueue(const DiffusionImage& image, const std::string& path) {
+    Task task;
+    task.path = path;
+    task.width = image.width;
+    task.height = image.height;
+    task.rgba.assign(image.pixels, image.pixels + static_cast<size_t>(image.width) * image.height * 4);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    cv_.notify_all();
+}
+
+void mls::DiffusionImageEncoder::WorkerLoop() {
+    pthread_setname_np(pthread_self(), "diffusion-encode");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        // queued tasks are still written out on shutdown
+        cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+            break;
+        }
+        Task task = std::move(tasks_.front());
+        tasks_.pop_front();
+        lock.unlock();
+        if (!Encode(task)) {
+            MNN_DEBUG("diffusion image encode failed: %s", task.path.c_str());
+        }
+        lock.lock();
+    }
+}
+
+bool mls::DiffusionImageEncoder::Encode(const Task& task) {
+    size_t pixel_count = static_cast<size_t>(task.width) * task.height;
+    std::vector<uint8_t> bgr(pixel_count * 3);
+    for (size_t i = 0; i < pixel_count; ++i) {
+        bgr[i * 3] = task.rgba[i * 4 + 2];
+        bgr[i * 3 + 1] = task.rgba[i * 4 + 1];
+        bgr[i * 3 + 2] = task.rgba[i * 4];
+    }
+    auto image = _Const(bgr.data(), {task.height, task.width, 3}, NHWC, halide_type_of<uint8_t>());
+    // keep the extension on the temp file, imwrite picks the encoder from it
+    auto slash = task.path.find_last_of('/');
+    std::string tmp_path = task.path.substr(0, slash == std::string::npos ? 0 : slash + 1) +
+            ".tmp_" + task.path.substr(slash == std::string::npos ? 0 : slash + 1);
+    if (!MNN::CV::imwrite(tmp_path, image)) {
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return rename(tmp_path.c_str(), task.path.c_str()) == 0;
+}
@@ -0,0 +1,52 @@
+//
+// Created on 2026/10/15.
+//
+
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mls {
+struct DiffusionImage {
+    int width{0};
+    int height{0};
+    // tightly packed RGBA8888, top row first
+    uint8_t* pixels{nullptr};
+    size_t capacity{0};
+};
+
+// Decodes an uncompressed 24/32 bit BMP, the cheapest format the engine can write.
+bool DecodeBmpToRgba(const std::vector<uint8_t>& bmp, DiffusionImage* image);
+
+// Encodes RGBA pixels to PNG/JPEG off the generation thread. The target path only
+// appears once the file is complete.
+class DiffusionImageEncoder {
+public:
+    DiffusionImageEncoder();
+    ~DiffusionImageEncoder();
+    // copies the pixels, the format follows the extension of |path|
+    void Enqueue(const DiffusionImage& image, const std::string& path);
+
+private:
+    struct Task {
+        std::string path;
+        int width;
+        int height;
+        std::vector<uint8_t> rgba;
+    };
+    void WorkerLoop();
+    static bool Encode(const Task& task);
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Task> tasks_;
+    bool stopping_{false};
+    std::thread worker_;
+};
+}
@@ -1,16 +1,199 @@
 #include <jni.h>
 #include "diffusion_session.h"
+#include "diffusion_job_queue.h"
+#include "diffusion_residency.h"
 #include "nlohmann/json.hpp"
 #include "mls_log.h"
 
 using namespace mls;
 using namespace nlohmann;
 
+// the app side passes every extra config value as a string
+static long GetConfigLong(const json& config, const char* key, long default_value) {
+    auto it = config.find(key);
+    if (it == config.end() || it->is_null()) {
+        return default_value;
+    }
+    if (it->is_string()) {
+        return std::stol(it->get<std::string>());
+    }
+    return it->get<long>();
+}
+
+static std::string GetConfigString(const json& config, const char* key, const std::string& default_value) {
+    auto it = config.find(key);
+    if (it == config.end() || !it->is_string()) {
+        return default_value;
+    }
+    return it->get<std::string>();
+}
+
+static MNNForwardType ParseBackend(const std::string& backend) {
+    if (backend == "cpu") {
+        return MNNForwardType::MNN_FORWARD_CPU;
+    }
+    if (backend == "vulkan") {
+        return MNNForwardType::MNN_FORWARD_VULKAN;
+    }
+    if (backend == "auto") {
+        return MNNForwardType::MNN_FORWARD_AUTO;
+    }
+    return MNNForwardType::MNN_FORWARD_OPENCL;
+}
+
+static std::string JStringToString(JNIEnv *env, jstring jstr) {
+    if (!jstr) {
+        return {};
+    }
+    const char* chars = env->GetStringUTFChars(jstr, nullptr);
+    std::string result(chars);
+    env->ReleaseStringUTFChars(jstr, chars);
+    return result;
+}
+
+static jobject NewHashMap(JNIEnv *env, jmethodID* put_method) {
+    jclass hashMapClass = env->FindClass("java/util/HashMap");
+    jmethodID hashMapInit = env->GetMethodID(hashMapClass, "<init>", "()V");
+    *put_method = env->GetMethodID(hashMapClass, "put", "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;");
+    jobject hashMap = env->NewObject(hashMapClass, hashMapInit);
+    env->DeleteLocalRef(hashMapClass);
+    return hashMap;
+}
+
+static void PutLong(JNIEnv *env, jobject hash_map, jmethodID put_method, const char* key, jlong value) {
+    jclass longClass = env->FindClass("java/lang/Long");
+    jmethodID longInit = env->GetMethodID(longClass, "<init>", "(J)V");
+    jstring jkey = env->NewStringUTF(key);
+    jobject jvalue = env->NewObject(longClass, longInit, value);
+    env->CallObjectMethod(hash_map, put_method, jkey, jvalue);
+    env->DeleteLocalRef(jvalue);
+    env->DeleteLocalRef(jkey);
+    env->DeleteLocalRef(longClass);
+}
+
+static void PutRunStats(JNIEnv *env, jobject hash_map, jmethodID put_method, const DiffusionRunStats& stats) {
+    PutLong(env, hash_map, put_method, "load_timeus", stats.load_us);
+    PutLong(env, hash_map, put_method, "text_encode_timeus", stats.text_encode_us);
+    PutLong(env, hash_map, put_method, "unet_steps", stats.unet_steps);
+    PutLong(env, hash_map, put_method, "unet_timeus", stats.unet_total_us);
+    PutLong(env, hash_map, put_method, "unet_step_min_timeus", stats.step_min_us);
+    PutLong(env, hash_map, put_method, "unet_step_avg_timeus", stats.step_avg_us);
+    PutLong(env, hash_map, put_method, "unet_step_p95_timeus", stats.step_p95_us);
+    PutLong(env, hash_map, put_method, "vae_decode_write_timeus", stats.vae_decode_write_us);
+    PutLong(env, hash_map, put_method, "output_timeus", stats.output_us);
+    PutLong(env, hash_map, put_method, "peak_rss_kb", stats.peak_rss_kb);
+    PutLong(env, hash_map, put_method, "output_hash", static_cast<jlong>(stats.output_hash));
+}
+
+// Bridges the Java ProgressListener, onProgress returning true stops the run.
+// Only valid for the duration of the JNI call that created it.
+static std::function<bool(int)> MakeProgressCallback(JNIEnv *env, jobject progress_listener) {
+    if (!progress_listener) {
+        return nullptr;
+    }
+    jclass progressListenerClass = env->GetObjectClass(progress_listener);
+    jmethodID onProgressMethod = env->GetMethodID(progressListenerClass, "onProgress", "(Ljava/lang/String;)Z");
+    env->DeleteLocalRef(progressListenerClass);
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+    }
+    if (!onProgressMethod) {
+        MNN_DEBUG("ProgressListener onProgress method not found.");
+        return nullptr;
+    }
+    return [env, progress_listener, onProgressMethod](int progress) {
+        jstring javaString =  env->NewStringUTF(std::to_string(progress).c_str());
+        bool stop = env->CallBooleanMethod(progress_listener, onProgressMethod,  javaString);
+        env->DeleteLocalRef(javaString);
+        if (env->ExceptionCheck()) {
+            // no JNI call may follow with an exception pending, a throwing listener stops the run
+            MNN_DEBUG("ProgressListener onProgress threw, stopping the run.");
+            env->ExceptionDescribe();
+            env->ExceptionClear();
+            return true;
+        }
+        return stop;
+    };
+}
+
+// put_method is handed back so callers can add entries of their own
+static jobject NewRunMetrics(JNIEnv *env, bool success, jlong total_time_us, const DiffusionRunInfo& run_info,
+                             jmethodID* put_method) {
+    jmethodID putMethod;
+    jobject hashMap = NewHashMap(env, &putMethod);
+    *put_method = putMethod;
+    PutLong(env, hashMap, putMethod, "total_timeus", total_time_us);
+    PutLong(env, hashMap, putMethod, "success", success ? 1 : 0);
+    PutLong(env, hashMap, putMethod, "cancelled", run_info.cancelled ? 1 : 0);
+    PutRunStats(env, hashMap, putMethod, run_info.stats);
+    return hashMap;
+}
+
 extern "C"
 JNIEXPORT void JNICALL
 Java_com_alibaba_mnnllm_android_llm_DiffusionSession_resetNative(JNIEnv *env, jobject thiz,
                                                                  jlong instance_id) {
+    auto* diffusion = reinterpret_cast<DiffusionSession*>(instance_id);
+    if (diffusion) {
+        diffusion->Reset();
+    }
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_alibaba_mnnllm_android_llm_DiffusionSession_cancelNative(JNIEnv *env, jobject thiz,
+                                                                  jlong instance_id) {
+    auto* diffusion = reinterpret_cast<DiffusionSession*>(instance_id);
+    if (diffusion) {
+        diffusion->Cancel();
+    }
+}
+
+// |buffer| is a direct ByteBuffer in native order of at least 56 bytes, see
+// DiffusionProgressChannel for the layout. The app polls it at its own frame
+// rate, so no JNI call or allocation happens per step. null detaches it.
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_alibaba_mnnllm_android_llm_DiffusionSession_setProgressBufferNative(JNIEnv *env, jobject thiz,
+                                                                             jlong instance_id,
+                                                                             jobject buffer,
+                                                                             jlong min_interval_ms) {
+    auto* diffusion = reinterpret_cast<DiffusionSession*>(instance_id);
+    if (!diffusion) {
+        return JNI_FALSE;
+    }
+    if (!buffer) {
+        diffusion->SetProgressChannel(nullptr);
+        return JNI_TRUE;
+    }
+    void* memory = env->GetDirectBufferAddress(buffer);
+    if (!memory || env->GetDirectBufferCapacity(buffer) < (jlong)DiffusionProgressChannel::kRequiredBytes
+        || reinterpret_cast<uintptr_t>(memory) % alignof(int64_t) != 0) {
+        MNN_DEBUG("diffusion progress buffer must be an aligned direct buffer of %zu bytes",
+                  DiffusionProgressChannel::kRequiredBytes);
+        return JNI_FALSE;
+    }
+    JavaVM* vm = nullptr;
+    env->GetJavaVM(&vm);
+    // the global ref keeps the buffer's memory alive for as long as a run may write to it
+    jobject buffer_ref = env->NewGlobalRef(buffer);
+    diffusion->SetProgressChannel(std::shared_ptr<DiffusionProgressChannel>(
+            new DiffusionProgressChannel(memory, std::chrono::milliseconds(std::max<jlong>(min_interval_ms, 0))),
+            [vm, buffer_ref](DiffusionProgressChannel* channel) {
+                JNIEnv* release_env = nullptr;
+                if (vm->GetEnv(reinterpret_cast<void**>(&release_env), JNI_VERSION_1_6) == JNI_OK) {
+                    release_env->DeleteGlobalRef(buffer_ref);
+                }
+                delete channel;
+            }));
+    return JNI_TRUE;
+}
 
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_alibaba_mnnllm_android_llm_DiffusionSession_onTrimMemoryNative(JNIEnv *env, jobject thiz,
+                                                                        jint level) {
+    DiffusionResidency::Instance().OnTrimMemory(level);
 }
 
 extern "C"
@@ -34,7 +217,23 @@ Java_com_alibaba_mnnllm_android_llm_DiffusionSession_initNative(JNIEnv *env,
     json extra_json_config = json::parse(extra_json_config_cstr);
     std::string diffusion_memory_mode = extra_json_config["diffusion_memory_mode"];
     int diffusion_memory_mode_int = std::stoi(diffusion_memory_mode);
-    auto diffusion = new DiffusionSession(config_path_cstr, diffusion_memory_mode_int);
+    long resident_budget_mb = GetConfigLong(extra_json_config, "diffusion_resident_budget_mb", -1);
+    if (resident_budget_mb >= 0) {
+        DiffusionResidency::Instance().SetBudget(static_cast<size_t>(resident_budget_mb) * 1024 * 1024);
+    }
+    long idle_unload_seconds = GetConfigLong(extra_json_config, "diffusion_idle_unload_seconds", -1);
+    if (idle_unload_seconds >= 0) {
+        DiffusionResidency::Instance().SetIdleTimeout(std::chrono::seconds(idle_unload_seconds));
+    }
+    DiffusionSessionConfig session_config;
+    session_config.memory_mode = diffusion_memory_mode_int;
+    session_config.backend = ParseBackend(GetConfigString(extra_json_config, "diffusion_backend", "opencl"));
+    session_config.cpu_big_cores = GetConfigString(extra_json_config, "diffusion_cpu_affinity", "big") == "big";
+    session_config.lazy_load = GetConfigString(extra_json_config, "diffusion_lazy_load", "false") == "true";
+    session_config.deterministic = GetConfigString(extra_json_config, "diffusion_deterministic", "false") == "true";
+    session_config.weight_variant = GetConfigString(extra_json_config, "diffusion_weight_variant", "");
+    session_config.overlay_dir = GetConfigString(extra_json_config, "diffusion_overlay_dir", "");
+    auto diffusion = new DiffusionSession(config_path_cstr, session_config);
     env->ReleaseStringUTFChars(extra_config_j, extra_json_config_cstr);
     env->ReleaseStringUTFChars(config_path, config_path_cstr);
     return reinterpret_cast<jlong>(diffusion);
@@ -53,31 +252,340 @@ Java_com_alibaba_mnnllm_android_llm_DiffusionSession_submitDiffusionNative(JNIEn
     if (!diffusion) {
         return nullptr;
     }
-    jclass progressListenerClass = env->GetObjectClass(progress_listener);
-    jmethodID onProgressMethod = env->GetMethodID(progressListenerClass, "onProgress", "(Ljava/lang/String;)Z");
-    if (!onProgressMethod) {
-        MNN_DEBUG("ProgressListener onProgress method not found.");
-    }
-    std::string prompt = env->GetStringUTFChars(input, nullptr);
-    std::string output_path = env->GetStringUTFChars(joutput_path, nullptr);
+    std::string prompt = JStringToString(env, input);
+    std::string output_path = JStringToString(env, joutput_path);
+    DiffusionRunInfo run_info;
     auto start = std::chrono::high_resolution_clock::now();
-    diffusion->Run(prompt,
+    bool success = diffusion->Run(prompt,
                    output_path,
                    iter_num,
                    random_seed,
-                   [env, progress_listener, onProgressMethod](int progress) {
-                       if (progress_listener && onProgressMethod) {
-                           jstring javaString =  env->NewStringUTF(std::to_string(progress).c_str());
-                           env->CallBooleanMethod(progress_listener, onProgressMethod,  javaString);
-                           env->DeleteLocalRef(javaString);
-                       }
-                   });
+                   MakeProgressCallback(env, progress_listener),
+                   nullptr,
+                   &run_info);
     auto end = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-    jclass hashMapClass = env->FindClass("java/util/HashMap");
-    jmethodID hashMapInit = env->GetMethodID(hashMapClass, "<init>", "()V");
-    jmethodID putMethod = env->GetMethodID(hashMapClass, "put", "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;");
-    jobject hashMap = env->NewObject(hashMapClass, hashMapInit);
-    env->CallObjectMethod(hashMap, putMethod, env->NewStringUTF("total_timeus"), env->NewObject(env->FindClass("java/lang/Long"), env->GetMethodID(env->FindClass("java/lang/Long"), "<init>", "(J)V"), duration));
+    jmethodID putMethod;
+    return NewRunMetrics(env, success, duration, run_info, &putMethod);
+}
+
+// max_iter_num bounds the step count picked for target_latency_ms, unet_steps reports the choice
+extern "C"
+JNIEXPORT jobject JNICALL
+Java_com_alibaba_mnnllm_android_llm_DiffusionSession_submitDiffusionWithinLatencyNative(JNIEnv *env,
+                                                                                        jobject thiz,
+                                                                                        jlong instance_id,
+                                                                                        jstring input,
+                                                                                        jstring joutput_path,
+                                                                                        jlong target_latency_ms,
+                                                                                        jint max_iter_num,
+                                                                                        jint random_seed,
+                                                                                        jobject progress_listener) {
+    auto* diffusion = reinterpret_cast<DiffusionSession*>(instance_id);
+    if (!diffusion || target_latency_ms <= 0) {
+        return nullptr;
+    }
+    std::string prompt = JStringToString(env, input);
+    std::string output_path = JStringToString(env, joutput_path);
+    DiffusionRunInfo run_info;
+    auto start = std::chrono::high_resolution_clock::now();
+    bool success = diffusion->RunWithinLatency(prompt,
+                                               output_path,
+                                               target_latency_ms,
+                                               max_iter_num,
+                                               random_seed,
+                                               MakeProgressCallback(env, progress_listener),
+                                               &run_info);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    jmethodID putMethod;
+    return NewRunMetrics(env, success, duration, run_info, &putMethod);
+}
+
+extern "C"
+JNIEXPORT jobject JNICALL
+Java_com_alibaba_mnnllm_android_llm_DiffusionSession_submitDiffusionBatchNative(JNIEnv *env,
+                                                                                jobject thiz,
+                                                                                jlong instance_id,
+                                                                                jstring input,
+                                                                                jobjectArray joutput_paths,
+                                                                                jint iter_num,
+                                                                                jintArray jrandom_seeds,
+                                                                                jobject progress_listener) {
+    auto* diffusion = reinterpret_cast<DiffusionSession*>(instance_id);
+    if (!diffusion || !joutput_paths || !jrandom_seeds) {
+        return nullptr;
+    }
+    jsize count = env->GetArrayLength(jrandom_seeds);
+    if (env->GetArrayLength(joutput_paths) != count) {
+        MNN_DEBUG("submitDiffusionBatchNative seeds and output paths differ in length.");
+        return nullptr;
+    }
+    std::vector<int> random_seeds(count);
+    std::vector<jint> jseeds(count);
+    env->GetIntArrayRegion(jrandom_seeds, 0, count, jseeds.data());
+    std::vector<std::string> output_paths;
+    for (jsize i = 0; i < count; ++i) {
+        random_seeds[i] = jseeds[i];
+        auto jpath = static_cast<jstring>(env->GetObjectArrayElement(joutput_paths, i));
+        output_paths.push_back(JStringToString(env, jpath));
+        env->DeleteLocalRef(jpath);
+    }
+    std::string prompt = JStringToString(env, input);
+    auto progress_callback = MakeProgressCallback(env, progress_listener);
+    jmethodID onImageReadyMethod = nullptr;
+    if (progress_listener) {
+        jclass progressListenerClass = env->GetObjectClass(progress_listener);
+        onImageReadyMethod = env->GetMethodID(progressListenerClass, "onImageReady", "(ILjava/lang/String;)V");
+        if (env->ExceptionCheck()) {
+            env->ExceptionClear();
+            onImageReadyMethod = nullptr;
+        }
+        env->DeleteLocalRef(progressListenerClass);
+    }
+    int images_done = 0;
+    DiffusionRunInfo run_info;
+    auto start = std::chrono::high_resolution_clock::now();
+    bool success = diffusion->RunBatch(prompt,
+                                       random_seeds,
+                                       output_paths,
+                                       iter_num,
+                                       [&progress_callback, count](int index, int progress) {
+                                           // progress is reported over the whole batch
+                                           return progress_callback &&
+                                                  progress_callback((index * 100 + progress) / count);
+                                       },
+                                       [env, diffusion, progress_listener, onImageReadyMethod, &images_done]
+                                               (int index, const std::string& image_path) {
+                                           images_done++;
+                                           if (!onImageReadyMethod) {
+                                               return;
+                                           }
+                                           jstring jpath = env->NewStringUTF(image_path.c_str());
+                                           env->CallVoidMethod(progress_listener, onImageReadyMethod, index, jpath);
+                                           env->DeleteLocalRef(jpath);
+                                           if (env->ExceptionCheck()) {
+                                               MNN_DEBUG("ProgressListener onImageReady threw, stopping the batch.");
+                                               env->ExceptionDescribe();
+                                               env->ExceptionClear();
+                                               // the batch holds the session, so this only stops its next image
+                                               diffusion->Cancel();
+                                           }
+                                       },
+                                       &run_info);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    jmethodID putMethod;
+    jobject hashMap = NewRunMetrics(env, success, duration, run_info, &putMethod);
+    PutLong(env, hashMap, putMethod, "images_done", images_done);
     return hashMap;
-}
\ No newline at end of file
+}
+
+extern "C"
+JNIEXPORT jobject JNICALL
+Java_com_alibaba_mnnllm_android_llm_DiffusionSession_submitDiffusionToBufferNative(JNIEnv *env,
+                                                                                   jobject thiz,
+                                                                                   jlong instance_id,
+                                                                                   jstring input,
+                                                                                   jstring jscratch_dir,
+                                                                                   jint iter_num,
+                                                                                   jint random_seed,
+                                                                                   jobject output_buffer,
+                                                                                   jstring jencode_path,
+                                                                                   jobject progress_listener) {
+    auto* diffusion = reinterpret_cast<DiffusionSession*>(instance_id);
+    if (!diffusion || !output_buffer) {
+        return nullptr;
+    }
+    DiffusionImage image;
+    image.pixels = static_cast<uint8_t*>(env->GetDirectBufferAddress(output_buffer));
+    image.capacity = static_cast<size_t>(env->GetDirectBufferCapacity(output_buffer));
+    if (!image.pixels) {
+        MNN_DEBUG("submitDiffusionToBufferNative output buffer is not direct.");
+        return nullptr;
+    }
+    std::string prompt = JStringToString(env, input);
+    std::string scratch_dir = JStringToString(env, jscratch_dir);
+    std::string encode_path = JStringToString(env, jencode_path);
+    DiffusionRunInfo run_info;
+    auto start = std::chrono::high_resolution_clock::now();
+    bool success = diffusion->RunToPixels(prompt,
+                                          scratch_dir,
+                                          iter_num,
+                                          random_seed,
+                                          &image,
+                                          encode_path,
+                                          MakeProgressCallback(env, progress_listener),
+                                          &run_info);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    jmethodID putMethod;
+    jobject hashMap = NewRunMetrics(env, success, duration, run_info, &putMethod);
+    PutLong(env, hashMap, putMethod, "width", image.width);
+    PutLong(env, hashMap, putMethod, "height", image.height);
+    return hashMap;
+}
+
+namespace {
+struct JniDiffusionJobQueue {
+    JavaVM* vm{nullptr};
+    // only valid on the queue's worker thread
+    JNIEnv* worker_env{nullptr};
+    jobject listener{nullptr};
+    jmethodID on_job_progress{nullptr};
+    jmethodID on_job_finished{nullptr};
+    std::unique_ptr<DiffusionJobQueue> queue;
+};
+
+jmethodID GetOptionalMethod(JNIEnv *env, jclass clazz, const char* name, const char* signature) {
+    jmethodID method = env->GetMethodID(clazz, name, signature);
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+        MNN_DEBUG("DiffusionJobListener %s method not found.", name);
+        return nullptr;
+    }
+    return method;
+}
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_com_alibaba_mnnllm_android_llm_DiffusionSession_createJobQueueNative(JNIEnv *env,
+                                                                          jobject thiz,
+                                                                          jlong instance_id,
+                                                                          jobject job_listener) {
+    auto* diffusion = reinterpret_cast<DiffusionSession*>(instance_id);
+    if (!diffusion) {
+        return 0;
+    }
+    auto* jni_queue = new JniDiffusionJobQueue();
+    env->GetJavaVM(&jni_queue->vm);
+    if (job_listener) {
+        jni_queue->listener = env->NewGlobalRef(job_listener);
+        jclass listenerClass = env->GetObjectClass(job_listener);
+        jni_queue->on_job_progress = GetOptionalMethod(env, listenerClass, "onJobProgress", "(JI)Z");
+        jni_queue->on_job_finished = GetOptionalMethod(env, listenerClass, "onJobFinished", "(JIJ)V");
+        env->DeleteLocalRef(listenerClass);
+    }
+    DiffusionJobQueue::ThreadHooks hooks;
+    hooks.on_start = [jni_queue] {
+        JavaVMAttachArgs args{JNI_VERSION_1_6, const_cast<char*>("diffusion-job"), nullptr};
+        jni_queue->vm->AttachCurrentThread(&jni_queue->worker_env, &args);
+    };
+    hooks.on_exit = [jni_queue] {
+        jni_queue->worker_env = nullptr;
+        jni_queue->vm->DetachCurrentThread();
+    };
+    jni_queue->queue = std::make_unique<DiffusionJobQueue>(
+            diffusion,
+            [jni_queue](int64_t job_id, int progress) {
+                JNIEnv* worker_env = jni_queue->worker_env;
+                if (!worker_env || !jni_queue->listener || !jni_queue->on_job_progress) {
+                    return false;
+                }
+                bool stop = worker_env->CallBooleanMethod(jni_queue->listener, jni_queue->on_job_progress,
+                                                          (jlong)job_id, (jint)progress);
+                if (worker_env->ExceptionCheck()) {
+                    worker_env->ExceptionDescribe();
+                    worker_env->ExceptionClear();
+                }
+                return stop;
+            },
+            [jni_queue](int64_t job_id, const DiffusionJobResult& result) {
+                JNIEnv* worker_env = jni_queue->worker_env;
+                if (!worker_env || !jni_queue->listener || !jni_queue->on_job_finished) {
+                    return;
+                }
+                worker_env->CallVoidMethod(jni_queue->listener, jni_queue->on_job_finished,
+                                           (jlong)job_id, (jint)result.state, (jlong)result.total_time_us);
+                if (worker_env->ExceptionCheck()) {
+                    worker_env->ExceptionDescribe();
+                    worker_env->ExceptionClear();
+                }
+            },
+            hooks);
+    return reinterpret_cast<jlong>(jni_queue);
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_com_alibaba_mnnllm_android_llm_DiffusionSession_submitJobNative(JNIEnv *env,
+                                                                     jobject thiz,
+                                                                     jlong queue_id,
+                                                                     jstring input,
+                                                                     jstring joutput_path,
+                                                                     jint iter_num,
+                                                                     jint random_seed,
+                                                                     jint priority) {
+    auto* jni_queue = reinterpret_cast<JniDiffusionJobQueue*>(queue_id);
+    if (!jni_queue) {
+        return 0;
+    }
+    DiffusionJobRequest request;
+    request.prompt = JStringToString(env, input);
+    request.output_path = JStringToString(env, joutput_path);
+    request.iter_num = iter_num;
+    request.random_seed = random_seed;
+    request.priority = priority;
+    return jni_queue->queue->Submit(std::move(request));
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_alibaba_mnnllm_android_llm_DiffusionSession_pollJobNative(JNIEnv *env,
+                                                                   jobject thiz,
+                                                                   jlong queue_id,
+                                                                   jlong job_id) {
+    auto* jni_queue = reinterpret_cast<JniDiffusionJobQueue*>(queue_id);
+    if (!jni_queue) {
+        return static_cast<jint>(DiffusionJobState::kUnknown);
+    }
+    return static_cast<jint>(jni_queue->queue->Poll(job_id));
+}
+
+extern "C"
+JNIEXPORT jobject JNICALL
+Java_com_alibaba_mnnllm_android_llm_DiffusionSession_awaitJobNative(JNIEnv *env,
+                                                                    jobject thiz,
+                                                                    jlong queue_id,
+                                                                    jlong job_id,
+                                                                    jlong timeout_ms) {
+    auto* jni_queue = reinterpret_cast<JniDiffusionJobQueue*>(queue_id);
+    DiffusionJobResult result;
+    if (!jni_queue || !jni_queue->queue->Await(job_id, timeout_ms, &result)) {
+        return nullptr;
+    }
+    jmethodID putMethod;
+    jobject hashMap = NewHashMap(env, &putMethod);
+    PutLong(env, hashMap, putMethod, "state", static_cast<jlong>(result.state));
+    PutLong(env, hashMap, putMethod, "total_timeus", result.total_time_us);
+    PutRunStats(env, hashMap, putMethod, result.stats);
+    return hashMap;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_alibaba_mnnllm_android_llm_DiffusionSession_cancelJobNative(JNIEnv *env,
+                                                                     jobject thiz,
+                                                                     jlong queue_id,
+                                                                     jlong job_id) {
+    auto* jni_queue = reinterpret_cast<JniDiffusionJobQueue*>(queue_id);
+    return jni_queue && jni_queue->queue->Cancel(job_id) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_alibaba_mnnllm_android_llm_DiffusionSession_releaseJobQueueNative(JNIEnv *env,
+                                                                           jobject thiz,
+                                                                           jlong queue_id) {
+    auto* jni_queue = reinterpret_cast<JniDiffusionJobQueue*>(queue_id);
+    if (!jni_queue) {
+        return;
+    }
+    // joins the worker, pending jobs finish as cancelled
+    jni_queue->queue.reset();
+    if (jni_queue->listener) {
+        env->DeleteGlobalRef(jni_queue->listener);
+    }
+    delete jni_queue;
+}
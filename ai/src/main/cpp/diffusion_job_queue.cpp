@@ -0,0 +1,200 @@
+//
+// Created on 2026/10/15.
+//
+
+#include "diffusion_job_queue.h"
+#include "diffusion_session.h"
+#include "mls_log.h"
+#include <algorithm>
+#include <chrono>
+#include <pthread.h>
+#include <utility>
+
+mls::DiffusionJobQueue::DiffusionJobQueue(DiffusionSession* session,
+                                          ProgressCallback progress_callback,
+                                          CompletionCallback completion_callback,
+                                          ThreadHooks hooks):
+        session_(session),
+        progress_callback_(std::move(progress_callback)),
+        completion_callback_(std::move(completion_callback)),
+        hooks_(std::move(hooks)) {
+    worker_ = std::thread(&DiffusionJobQueue::WorkerLoop, this);
+}
+
+mls::DiffusionJobQueue::~DiffusionJobQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        if (running_job_ != 0) {
+            cancel_running_ = true;
+        }
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+int64_t mls::DiffusionJobQueue::Submit(DiffusionJobRequest request) {
+    int64_t job_id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_id = next_job_id_++;
+        pending_.push_back({job_id, next_sequence_++, std::move(request)});
+    }
+    cv_.notify_all();
+    return job_id;
+}
+
+bool mls::DiffusionJobQueue::Cancel(int64_t job_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_job_ == job_id) {
+        // only this job's run sees the token, a synchronous run holding the session is untouched
+        cancel_running_ = true;
+        return true;
+    }
+    for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+        if (it->id == job_id) {
+            pending_.erase(it);
+            DiffusionJobResult result;
+            result.state = DiffusionJobState::kCancelled;
+            FinishLocked(job_id, result);
+            cv_.notify_all();
+            return true;
+        }
+    }
+    return false;
+}
+
+mls::DiffusionJobState mls::DiffusionJobQueue::Poll(int64_t job_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_job_ == job_id) {
+        return DiffusionJobState::kRunning;
+    }
+    auto it = finished_.find(job_id);
+    if (it != finished_.end()) {
+        return it->second.state;
+    }
+    for (const auto& job : pending_) {
+        if (job.id == job_id) {
+            return DiffusionJobState::kQueued;
+        }
+    }
+    return DiffusionJobState::kUnknown;
+}
+
+bool mls::DiffusionJobQueue::Await(int64_t job_id, int64_t timeout_ms, DiffusionJobResult* result) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool known = running_job_ == job_id || finished_.count(job_id) > 0 ||
+                 std::any_of(pending_.begin(), pending_.end(), [job_id](const Job& job) { return job.id == job_id; });
+    if (!known) {
+        // unknown, already awaited or dropped by the finished cap: nothing will ever finish it
+        return false;
+    }
+    auto done = [this, job_id] {
+        return finished_.count(job_id) > 0 || (stopping_ && running_job_ == 0);
+    };
+    if (timeout_ms < 0) {
+        cv_.wait(lock, done);
+    } else if (!cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), done)) {
+        return false;
+    }
+    auto it = finished_.find(job_id);
+    if (it == finished_.end()) {
+        return false;
+    }
+    if (result) {
+        *result = it->second;
+    }
+    finished_.erase(it);
+    return true;
+}
+
+bool mls::DiffusionJobQueue::PopNextLocked(Job* job) {
+    if (pending_.empty()) {
+        return false;
+    }
+    auto best = pending_.begin();
+    for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+        if (it->request.priority > best->request.priority ||
+            (it->request.priority == best->request.priority && it->sequence < best->sequence)) {
+            best = it;
+        }
+    }
+    *job = std::move(*best);
+    pending_.erase(best);
+    return true;
+}
+
+void mls::DiffusionJobQueue::FinishLocked(int64_t job_id, const DiffusionJobResult& result) {
+    finished_[job_id] = result;
+    finished_order_.push_back(job_id);
+    // results nobody awaited are dropped oldest first
+    while (finished_order_.size() > kMaxFinishedJobs) {
+        finished_.erase(finished_order_.front());
+        finished_order_.pop_front();
+    }
+}
+
+void mls::DiffusionJobQueue::WorkerLoop() {
+    pthread_setname_np(pthread_self(), "diffusion-job");
+    if (hooks_.on_start) {
+        hooks_.on_start();
+    }
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+            if (stopping_) {
+                for (const auto& pending : pending_) {
+                    DiffusionJobResult result;
+                    result.state = DiffusionJobState::kCancelled;
+                    FinishLocked(pending.id, result);
+                }
+                pending_.clear();
+                break;
+            }
+            PopNextLocked(&job);
+            running_job_ = job.id;
+            cancel_running_ = false;
+        }
+        MNN_DEBUG("diffusion job %lld start priority: %d", (long long)job.id, job.request.priority);
+        auto start = std::chrono::steady_clock::now();
+        DiffusionRunInfo run_info;
+        bool success = session_->Run(job.request.prompt,
+                                     job.request.output_path,
+                                     job.request.iter_num,
+                                     job.request.random_seed,
+                                     [this, &job](int progress) {
+                                         return progress_callback_ && progress_callback_(job.id, progress);
+                                     },
+                                     &cancel_running_,
+                                     &run_info);
+        DiffusionJobResult result;
+        result.total_time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        result.stats = run_info.stats;
+        if (success) {
+            result.state = DiffusionJobState::kDone;
+        } else if (run_info.cancelled) {
+            result.state = DiffusionJobState::kCancelled;
+        } else {
+            result.state = DiffusionJobState::kFailed;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_job_ = 0;
+            FinishLocked(job.id, result);
+        }
+        cv_.notify_all();
+        // after the result is recorded, so the callback can Poll or Await the job
+        if (completion_callback_) {
+            completion_callback_(job.id, result);
+        }
+    }
+    cv_.notify_all();
+    if (hooks_.on_exit) {
+        hooks_.on_exit();
+    }
+}
@@ -0,0 +1,101 @@
+//
+// Created on 2026/10/15.
+//
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "diffusion_stats.h"
+
+namespace mls {
+class DiffusionSession;
+
+enum class DiffusionJobState {
+    kUnknown = 0,
+    kQueued = 1,
+    kRunning = 2,
+    kDone = 3,
+    kFailed = 4,
+    kCancelled = 5,
+};
+
+struct DiffusionJobRequest {
+    std::string prompt;
+    std::string output_path;
+    // 0 uses the model family default
+    int iter_num{0};
+    int random_seed{0};
+    // higher runs first, equal priorities run in submit order
+    int priority{0};
+};
+
+struct DiffusionJobResult {
+    DiffusionJobState state{DiffusionJobState::kUnknown};
+    int64_t total_time_us{0};
+    DiffusionRunStats stats;
+};
+
+// Runs diffusion jobs for one session on a dedicated worker thread.
+class DiffusionJobQueue {
+public:
+    // both callbacks are invoked on the worker thread, the completion callback once the
+    // result can be polled and awaited
+    using ProgressCallback = std::function<bool(int64_t job_id, int progress)>;
+    using CompletionCallback = std::function<void(int64_t job_id, const DiffusionJobResult& result)>;
+    struct ThreadHooks {
+        std::function<void()> on_start;
+        std::function<void()> on_exit;
+    };
+
+    DiffusionJobQueue(DiffusionSession* session, ProgressCallback progress_callback,
+                      CompletionCallback completion_callback, ThreadHooks hooks);
+    ~DiffusionJobQueue();
+
+    int64_t Submit(DiffusionJobRequest request);
+    // Removes a queued job or stops the running one, false if the job already finished.
+    bool Cancel(int64_t job_id);
+    DiffusionJobState Poll(int64_t job_id);
+    // Waits for the job to finish, a negative timeout waits forever. The finished
+    // result is handed out once and then forgotten, false right away for an id that
+    // is unknown or whose result is gone.
+    bool Await(int64_t job_id, int64_t timeout_ms, DiffusionJobResult* result);
+
+private:
+    struct Job {
+        int64_t id;
+        uint64_t sequence;
+        DiffusionJobRequest request;
+    };
+    void WorkerLoop();
+    bool PopNextLocked(Job* job);
+    void FinishLocked(int64_t job_id, const DiffusionJobResult& result);
+
+    static constexpr size_t kMaxFinishedJobs = 64;
+
+    DiffusionSession* session_;
+    ProgressCallback progress_callback_;
+    CompletionCallback completion_callback_;
+    ThreadHooks hooks_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> pending_;
+    std::map<int64_t, DiffusionJobResult> finished_;
+    std::deque<int64_t> finished_order_;
+    int64_t running_job_{0};
+    // the running job's cancel token, also covers a cancel that lands before the
+    // session starts its run
+    std::atomic<bool> cancel_running_{false};
+    int64_t next_job_id_{1};
+    uint64_t next_sequence_{0};
+    bool stopping_{false};
+    std::thread worker_;
+};
+}
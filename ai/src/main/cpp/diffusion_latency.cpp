@@ -0,0 +1,127 @@
+//
+// Created on 2026/10/15.
+//
+
+#include "diffusion_latency.h"
+#include "mls_log.h"
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+
+namespace {
+constexpr uint32_t kMagic = 0x4c534c4d; // "MLSL"
+constexpr uint32_t kVersion = 1;
+// weight of the newest run, high enough to follow thermal state and driver updates
+constexpr double kSmoothing = 0.3;
+// a measured step counts as much as this many steps of history when predicting
+constexpr double kHistoryWeightSteps = 2.0;
+// one entry per backend and thread count, anything above this is a corrupt file
+constexpr uint32_t kMaxEntries = 64;
+
+void Smooth(double* average, double sample, bool first) {
+    *average = first ? sample : *average + kSmoothing * (sample - *average);
+}
+}
+
+mls::DiffusionLatencyModel::DiffusionLatencyModel(std::string path, int backend, int threads):
+        path_(std::move(path)),
+        backend_(backend),
+        threads_(threads) {
+    Load();
+}
+
+void mls::DiffusionLatencyModel::Load() {
+    FILE* file = fopen(path_.c_str(), "rb");
+    if (!file) {
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint32_t header[3] = {0, 0, 0};
+    if (fread(header, sizeof(header), 1, file) == 1 && header[0] == kMagic && header[1] == kVersion &&
+        header[2] <= kMaxEntries && size == static_cast<long>(sizeof(header) + header[2] * sizeof(Entry))) {
+        records_.resize(header[2]);
+        if (header[2] > 0 && fread(records_.data(), sizeof(Entry), records_.size(), file) != records_.size()) {
+            records_.clear();
+        }
+    }
+    fclose(file);
+    for (const auto& record : records_) {
+        if (record.backend == backend_ && record.threads == threads_) {
+            estimate_ = record.estimate;
+        }
+    }
+}
+
+void mls::DiffusionLatencyModel::Save() const {
+    std::string temp_path = path_ + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        MNN_DEBUG("diffusion latency history not writable: %s", path_.c_str());
+        return;
+    }
+    uint32_t header[3] = {kMagic, kVersion, static_cast<uint32_t>(records_.size())};
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1
+              && fwrite(records_.data(), sizeof(Entry), records_.size(), file) == records_.size();
+    ok = fclose(file) == 0 && ok;
+    // readers see either the old or the new file, never a partial one
+    if (!ok || rename(temp_path.c_str(), path_.c_str()) != 0) {
+        remove(temp_path.c_str());
+    }
+}
+
+void mls::DiffusionLatencyModel::Record(const DiffusionRunStats& stats) {
+    if (stats.unet_steps <= 0) {
+        return;
+    }
+    bool first = estimate_.runs == 0;
+    if (stats.load_us > 0) {
+        Smooth(&estimate_.load_ms, stats.load_us / 1000.0, estimate_.load_ms == 0);
+    }
+    Smooth(&estimate_.text_encode_ms, stats.text_encode_us / 1000.0, first);
+    Smooth(&estimate_.step_ms, stats.unet_total_us / 1000.0 / stats.unet_steps, first);
+    Smooth(&estimate_.decode_ms, stats.vae_decode_write_us / 1000.0, first);
+    estimate_.runs++;
+    auto it = std::find_if(records_.begin(), records_.end(), [this](const Entry& record) {
+        return record.backend == backend_ && record.threads == threads_;
+    });
+    if (it == records_.end()) {
+        if (records_.size() >= kMaxEntries) {
+            records_.erase(records_.begin());
+        }
+        records_.push_back({backend_, threads_, estimate_});
+    } else {
+        it->estimate = estimate_;
+    }
+    Save();
+}
+
+int64_t mls::DiffusionLatencyModel::PredictRemainingMs(int step, int total_steps, int64_t unet_ms) const {
+    double step_ms;
+    if (HasHistory() && step > 0) {
+        // lean on the measured pace as steps accumulate, it reflects the current thermal state
+        step_ms = (unet_ms + estimate_.step_ms * kHistoryWeightSteps) / (step + kHistoryWeightSteps);
+    } else if (HasHistory()) {
+        step_ms = estimate_.step_ms;
+    } else if (step > 0) {
+        step_ms = static_cast<double>(unet_ms) / step;
+    } else {
+        return -1;
+    }
+    double remaining = step_ms * std::max(total_steps - step, 0) + estimate_.decode_ms;
+    return static_cast<int64_t>(remaining);
+}
+
+int mls::DiffusionLatencyModel::StepsForBudget(int64_t budget_ms, bool include_load, int min_steps,
+                                               int max_steps) const {
+    if (!HasHistory() || estimate_.step_ms <= 0) {
+        return 0;
+    }
+    double fixed_ms = estimate_.text_encode_ms + estimate_.decode_ms + (include_load ? estimate_.load_ms : 0);
+    int steps = static_cast<int>((budget_ms - fixed_ms) / estimate_.step_ms);
+    if (steps < min_steps) {
+        return 0;
+    }
+    return std::min(steps, max_steps);
+}
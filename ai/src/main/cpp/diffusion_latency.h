@@ -0,0 +1,54 @@
+//
+// Created on 2026/10/15.
+//
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "diffusion_stats.h"
+
+namespace mls {
+// Smoothed stage latencies of past runs of one model on one backend setup.
+struct DiffusionLatencyEstimate {
+    int64_t runs{0};
+    double load_ms{0};
+    double text_encode_ms{0};
+    double step_ms{0};
+    double decode_ms{0};
+};
+
+// Per-step latency history of a model on this device, persisted in a small binary
+// file so ETAs are right from the first step of the first run after a restart.
+// Not thread safe, DiffusionSession only touches it under its run lock.
+class DiffusionLatencyModel {
+public:
+    // |backend| and |threads| separate records of the same model run different ways
+    DiffusionLatencyModel(std::string path, int backend, int threads);
+    const DiffusionLatencyEstimate& Estimate() const { return estimate_; }
+    bool HasHistory() const { return estimate_.runs > 0; }
+    // Folds a finished run into the history and saves it.
+    void Record(const DiffusionRunStats& stats);
+    // Predicted time until the image is written, -1 without history and measurements.
+    // |unet_ms| is the time spent on the |step| steps done so far.
+    int64_t PredictRemainingMs(int step, int total_steps, int64_t unet_ms) const;
+    // Most steps in [min_steps, max_steps] whose predicted run time fits |budget_ms|,
+    // 0 when even min_steps does not fit or there is no history.
+    int StepsForBudget(int64_t budget_ms, bool include_load, int min_steps, int max_steps) const;
+
+private:
+    struct Entry {
+        int32_t backend;
+        int32_t threads;
+        DiffusionLatencyEstimate estimate;
+    };
+    void Load();
+    void Save() const;
+
+    std::string path_;
+    int32_t backend_;
+    int32_t threads_;
+    std::vector<Entry> records_;
+    DiffusionLatencyEstimate estimate_;
+};
+}
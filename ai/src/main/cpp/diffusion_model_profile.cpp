@@ -0,0 +1,85 @@
+//
+// Created on 2026/10/15.
+//
+
+#include "diffusion_model_profile.h"
+#include "mls_log.h"
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <unistd.h>
+
+using namespace nlohmann;
+
+namespace {
+mls::DiffusionModelProfile MakeProfile(mls::DiffusionModelFamily family) {
+    mls::DiffusionModelProfile profile;
+    profile.family = family;
+    switch (family) {
+        case mls::DiffusionModelFamily::kTaiyiChinese:
+            profile.engine_type = MNN::DIFFUSION::DiffusionModelType::STABLE_DIFFUSION_TAIYI_CHINESE;
+            profile.default_steps = 20;
+            break;
+        case mls::DiffusionModelFamily::kTurbo:
+        case mls::DiffusionModelFamily::kLcm:
+            // a handful of PLMS steps with guidance gives poor images from these checkpoints
+            MNN_DEBUG("diffusion model family %d needs few-step sampling the engine lacks, "
+                      "running the SD 1.5 sampler", (int)family);
+            profile.default_steps = 20;
+            break;
+        case mls::DiffusionModelFamily::kStableDiffusion15:
+            profile.default_steps = 20;
+            break;
+    }
+    return profile;
+}
+
+bool FamilyFromModelType(std::string model_type, mls::DiffusionModelFamily* family) {
+    std::transform(model_type.begin(), model_type.end(), model_type.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    static const struct {
+        const char* model_type;
+        mls::DiffusionModelFamily family;
+    } kModelTypes[] = {
+            {"sd15", mls::DiffusionModelFamily::kStableDiffusion15},
+            {"stable-diffusion-1.5", mls::DiffusionModelFamily::kStableDiffusion15},
+            {"stable_diffusion_1_5", mls::DiffusionModelFamily::kStableDiffusion15},
+            {"taiyi", mls::DiffusionModelFamily::kTaiyiChinese},
+            {"stable_diffusion_taiyi_chinese", mls::DiffusionModelFamily::kTaiyiChinese},
+            {"sd-turbo", mls::DiffusionModelFamily::kTurbo},
+            {"turbo", mls::DiffusionModelFamily::kTurbo},
+            {"lcm", mls::DiffusionModelFamily::kLcm},
+    };
+    for (const auto& entry : kModelTypes) {
+        if (model_type == entry.model_type) {
+            *family = entry.family;
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+mls::DiffusionModelProfile mls::DetectModelProfile(const std::string& resource_path) {
+    std::ifstream config_file(resource_path + "/config.json");
+    if (config_file) {
+        json config = json::parse(config_file, nullptr, false);
+        DiffusionModelFamily family;
+        if (config.is_object() && config.contains("model_type") && config["model_type"].is_string() &&
+            FamilyFromModelType(config["model_type"].get<std::string>(), &family)) {
+            auto profile = MakeProfile(family);
+            if (config.contains("default_steps") && config["default_steps"].is_number_integer() &&
+                config["default_steps"].get<int>() > 0) {
+                profile.default_steps = config["default_steps"].get<int>();
+            }
+            return profile;
+        }
+    }
+    // the Taiyi text encoder uses a BERT vocab.txt, CLIP based models ship vocab.json + merges.txt
+    if (access((resource_path + "/vocab.txt").c_str(), R_OK) == 0 &&
+        access((resource_path + "/merges.txt").c_str(), R_OK) != 0) {
+        return MakeProfile(DiffusionModelFamily::kTaiyiChinese);
+    }
+    return MakeProfile(DiffusionModelFamily::kStableDiffusion15);
+}
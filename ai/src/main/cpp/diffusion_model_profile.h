@@ -0,0 +1,29 @@
+//
+// Created on 2026/10/15.
+//
+
+#pragma once
+#include <string>
+#include "diffusion/diffusion.hpp"
+
+namespace mls {
+enum class DiffusionModelFamily {
+    kStableDiffusion15,
+    kTaiyiChinese,
+    // distilled checkpoints that need guidance-free or LCM sampling. The engine only
+    // runs PLMS with classifier-free guidance, so they get the SD 1.5 step count
+    kTurbo,
+    kLcm,
+};
+
+struct DiffusionModelProfile {
+    DiffusionModelFamily family{DiffusionModelFamily::kStableDiffusion15};
+    MNN::DIFFUSION::DiffusionModelType engine_type{MNN::DIFFUSION::DiffusionModelType::STABLE_DIFFUSION_1_5};
+    // used when a run asks for 0 steps
+    int default_steps{20};
+};
+
+// Detects the family from "model_type" (and optional "default_steps") in the
+// model's config.json, falling back to the tokenizer files.
+DiffusionModelProfile DetectModelProfile(const std::string& resource_path);
+}
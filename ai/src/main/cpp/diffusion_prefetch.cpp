@@ -0,0 +1,89 @@
+//
+// Created on 2026/10/15.
+//
+
+#include "diffusion_prefetch.h"
+#include "mls_log.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+int LoadOrder(const std::string& name) {
+    if (name.rfind("text_encoder", 0) == 0) {
+        return 0;
+    }
+    if (name.rfind("unet", 0) == 0) {
+        return 1;
+    }
+    if (name.rfind("vae", 0) == 0) {
+        return 3;
+    }
+    return 2;
+}
+
+// advise in chunks so a stop request is honoured between them
+constexpr off_t kChunkBytes = 8 * 1024 * 1024;
+}
+
+mls::WeightPrefetcher::~WeightPrefetcher() {
+    Stop();
+}
+
+std::vector<std::string> mls::WeightPrefetcher::ListWeightFiles(const std::string& resource_path) {
+    std::vector<std::string> names;
+    DIR* dir = opendir(resource_path.c_str());
+    if (!dir) {
+        return names;
+    }
+    while (auto* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.find(".mnn") != std::string::npos) {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+    std::stable_sort(names.begin(), names.end(), [](const std::string& a, const std::string& b) {
+        int order_a = LoadOrder(a);
+        int order_b = LoadOrder(b);
+        return order_a != order_b ? order_a < order_b : a < b;
+    });
+    std::vector<std::string> files;
+    for (const auto& name : names) {
+        files.push_back(resource_path + "/" + name);
+    }
+    return files;
+}
+
+void mls::WeightPrefetcher::Start(std::vector<std::string> files) {
+    Stop();
+    stop_ = false;
+    worker_ = std::thread([this, files = std::move(files)] {
+        pthread_setname_np(pthread_self(), "diffusion-fetch");
+        for (const auto& file : files) {
+            int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+            struct stat st{};
+            fstat(fd, &st);
+            for (off_t offset = 0; offset < st.st_size && !stop_; offset += kChunkBytes) {
+                posix_fadvise(fd, offset, std::min(kChunkBytes, st.st_size - offset), POSIX_FADV_WILLNEED);
+            }
+            close(fd);
+            if (stop_) {
+                break;
+            }
+        }
+    });
+}
+
+void mls::WeightPrefetcher::Stop() {
+    stop_ = true;
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
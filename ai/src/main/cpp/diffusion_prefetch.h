@@ -0,0 +1,29 @@
+//
+// Created on 2026/10/15.
+//
+
+#pragma once
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mls {
+// Pulls weight files into the kernel page cache on a background thread, so the
+// engine's own reads hit memory. The page cache is shared by every session and
+// survives session teardown.
+class WeightPrefetcher {
+public:
+    ~WeightPrefetcher();
+    // Weight files under |resource_path| in the order the pipeline needs them:
+    // text encoder, UNet, everything else, VAE decoder last.
+    static std::vector<std::string> ListWeightFiles(const std::string& resource_path);
+    // Restarts prefetching, a prefetch still in flight is stopped first.
+    void Start(std::vector<std::string> files);
+    void Stop();
+
+private:
+    std::thread worker_;
+    std::atomic<bool> stop_{false};
+};
+}
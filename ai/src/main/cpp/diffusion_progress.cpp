@@ -0,0 +1,35 @@
+//
+// Created on 2026/10/15.
+//
+
+#include "diffusion_progress.h"
+
+mls::DiffusionProgressChannel::DiffusionProgressChannel(void* memory, std::chrono::milliseconds min_interval):
+        slots_(static_cast<int64_t*>(memory)),
+        min_interval_(min_interval) {
+    for (size_t slot = 0; slot < kSlotCount; ++slot) {
+        Store(slot, 0);
+    }
+}
+
+void mls::DiffusionProgressChannel::Publish(const DiffusionProgress& progress, bool force) {
+    auto now = std::chrono::steady_clock::now();
+    force = force || progress.stage != last_stage_;
+    if (!force && now - last_publish_ < min_interval_) {
+        return;
+    }
+    last_publish_ = now;
+    last_stage_ = progress.stage;
+    Store(0, ++sequence_);
+    Store(1, progress.progress);
+    Store(2, static_cast<int64_t>(progress.stage));
+    Store(3, progress.step);
+    Store(4, progress.total_steps);
+    Store(5, progress.eta_ms);
+    Store(6, progress.elapsed_ms);
+    Store(0, ++sequence_);
+}
+
+void mls::DiffusionProgressChannel::Store(size_t slot, int64_t value) {
+    __atomic_store_n(&slots_[slot], value, __ATOMIC_RELEASE);
+}
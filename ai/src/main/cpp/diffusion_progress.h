@@ -0,0 +1,54 @@
+//
+// Created on 2026/10/15.
+//
+
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace mls {
+enum class DiffusionStage {
+    kIdle = 0,
+    kLoading = 1,
+    kTextEncode = 2,
+    kDenoise = 3,
+    kDecode = 4,
+    kDone = 5,
+};
+
+struct DiffusionProgress {
+    int64_t progress{0};
+    DiffusionStage stage{DiffusionStage::kIdle};
+    int64_t step{0};
+    int64_t total_steps{0};
+    // -1 while unknown
+    int64_t eta_ms{-1};
+    int64_t elapsed_ms{0};
+};
+
+// Publishes progress into memory shared with Java (a direct ByteBuffer in native
+// order) without any JNI call. Layout, one int64 per slot:
+//   0 sequence, odd while a write is in progress
+//   1 progress 0..100, 2 stage, 3 step, 4 total steps, 5 eta ms, 6 elapsed ms
+// Readers retry until they see the same even sequence before and after reading.
+class DiffusionProgressChannel {
+public:
+    static constexpr size_t kSlotCount = 7;
+    static constexpr size_t kRequiredBytes = kSlotCount * sizeof(int64_t);
+
+    DiffusionProgressChannel(void* memory, std::chrono::milliseconds min_interval);
+    // Updates closer together than min_interval are dropped unless forced, stage
+    // changes are always forced.
+    void Publish(const DiffusionProgress& progress, bool force = false);
+
+private:
+    void Store(size_t slot, int64_t value);
+
+    int64_t* slots_;
+    std::chrono::milliseconds min_interval_;
+    std::chrono::steady_clock::time_point last_publish_{};
+    DiffusionStage last_stage_{DiffusionStage::kIdle};
+    int64_t sequence_{0};
+};
+}
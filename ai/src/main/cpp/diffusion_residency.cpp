@@ -0,0 +1,185 @@
+//
+// Created on 2026/10/15.
+//
+
+#include "diffusion_residency.h"
+#include "diffusion_session.h"
+#include "mls_log.h"
+#include <algorithm>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+namespace {
+// android.content.ComponentCallbacks2
+constexpr int kTrimMemoryRunningCritical = 15;
+constexpr int kTrimMemoryBackground = 40;
+
+constexpr std::chrono::seconds kMaxIdleCheckInterval{5};
+}
+
+mls::DiffusionResidency& mls::DiffusionResidency::Instance() {
+    static DiffusionResidency instance;
+    return instance;
+}
+
+mls::DiffusionResidency::~DiffusionResidency() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    idle_cv_.notify_all();
+    if (idle_thread_.joinable()) {
+        idle_thread_.join();
+    }
+}
+
+void mls::DiffusionResidency::SetBudget(size_t budget_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_bytes_ = budget_bytes;
+    EvictLocked(nullptr, 0);
+}
+
+size_t mls::DiffusionResidency::Budget() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return budget_bytes_;
+}
+
+void mls::DiffusionResidency::SetIdleTimeout(std::chrono::seconds timeout) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_timeout_ = timeout;
+    if (idle_timeout_.count() > 0 && !idle_thread_.joinable()) {
+        idle_thread_ = std::thread(&DiffusionResidency::IdleLoop, this);
+    }
+    idle_cv_.notify_all();
+}
+
+void mls::DiffusionResidency::OnTrimMemory(int level) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MNN_DEBUG("diffusion residency trim memory level: %d resident: %zu", level, resident_bytes_);
+    // weights are the expensive thing to get back, so they go last and the
+    // hottest session keeps them until the app is in the background
+    if (level >= kTrimMemoryRunningCritical) {
+        bool keep_hottest = level < kTrimMemoryBackground;
+        for (auto& entry : entries_) {
+            if (entry.bytes == 0) {
+                continue;
+            }
+            if (keep_hottest) {
+                keep_hottest = false;
+                continue;
+            }
+            UnloadLocked(entry);
+        }
+    }
+}
+
+void mls::DiffusionResidency::Register(DiffusionSession* session) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_back({session, 0, Clock::now()});
+}
+
+void mls::DiffusionResidency::Unregister(DiffusionSession* session) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = FindLocked(session);
+    if (it != entries_.end()) {
+        resident_bytes_ -= it->bytes;
+        entries_.erase(it);
+    }
+}
+
+void mls::DiffusionResidency::Acquire(DiffusionSession* session, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = FindLocked(session);
+    if (it == entries_.end()) {
+        return;
+    }
+    resident_bytes_ -= it->bytes;
+    it->bytes = 0;
+    EvictLocked(session, bytes);
+    it->bytes = bytes;
+    it->last_used = Clock::now();
+    resident_bytes_ += bytes;
+    entries_.splice(entries_.begin(), entries_, it);
+    MNN_DEBUG("diffusion residency acquire %zu bytes, resident: %zu budget: %zu",
+              bytes, resident_bytes_, budget_bytes_);
+}
+
+void mls::DiffusionResidency::Touch(DiffusionSession* session) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = FindLocked(session);
+    if (it != entries_.end()) {
+        it->last_used = Clock::now();
+        entries_.splice(entries_.begin(), entries_, it);
+    }
+}
+
+void mls::DiffusionResidency::EvictLocked(DiffusionSession* keep, size_t incoming_bytes) {
+    if (budget_bytes_ == 0) {
+        return;
+    }
+    // walk from the coldest end, sessions that are busy running are skipped
+    for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+        if (resident_bytes_ + incoming_bytes <= budget_bytes_) {
+            break;
+        }
+        if (it->session != keep && it->bytes > 0) {
+            UnloadLocked(*it);
+        }
+    }
+}
+
+bool mls::DiffusionResidency::UnloadLocked(Entry& entry) {
+    if (!entry.session->TryUnload()) {
+        return false;
+    }
+    MNN_DEBUG("diffusion residency unload %zu bytes", entry.bytes);
+    resident_bytes_ -= entry.bytes;
+    entry.bytes = 0;
+    return true;
+}
+
+void mls::DiffusionResidency::IdleLoop() {
+    pthread_setname_np(pthread_self(), "diffusion-idle");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (idle_timeout_.count() == 0) {
+            idle_cv_.wait(lock);
+            continue;
+        }
+        auto now = Clock::now();
+        for (auto& entry : entries_) {
+            if (entry.bytes > 0 && now - entry.last_used >= idle_timeout_) {
+                UnloadLocked(entry);
+            }
+        }
+        idle_cv_.wait_for(lock, std::min(idle_timeout_, kMaxIdleCheckInterval));
+    }
+}
+
+std::list<mls::DiffusionResidency::Entry>::iterator
+mls::DiffusionResidency::FindLocked(DiffusionSession* session) {
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->session == session) {
+            return it;
+        }
+    }
+    return entries_.end();
+}
+
+size_t mls::DiffusionResidency::EstimateWeightBytes(const std::string& resource_path) {
+    size_t total = 0;
+    DIR* dir = opendir(resource_path.c_str());
+    if (!dir) {
+        return 0;
+    }
+    while (auto* entry = readdir(dir)) {
+        std::string path = resource_path + "/" + entry->d_name;
+        struct stat st{};
+        if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            total += static_cast<size_t>(st.st_size);
+        }
+    }
+    closedir(dir);
+    return total;
+}
@@ -0,0 +1,67 @@
+//
+// Created on 2026/10/15.
+//
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace mls {
+class DiffusionSession;
+
+// Process wide memory policy for diffusion sessions. Every live session is
+// registered; sessions that keep weights loaded between runs also report the
+// bytes they hold. Weights are dropped when the budget is exceeded (least
+// recently used first), after an idle timeout, or on Android trim memory events.
+class DiffusionResidency {
+public:
+    static DiffusionResidency& Instance();
+
+    // 0 disables the budget, resident sessions then stay loaded until idle or trimmed.
+    void SetBudget(size_t budget_bytes);
+    size_t Budget();
+    // 0 disables idle unloading.
+    void SetIdleTimeout(std::chrono::seconds timeout);
+    // ComponentCallbacks2 trim level, drops weights as the level rises.
+    void OnTrimMemory(int level);
+
+    void Register(DiffusionSession* session);
+    void Unregister(DiffusionSession* session);
+    // Makes room for |bytes| and marks |session| as the most recently used.
+    void Acquire(DiffusionSession* session, size_t bytes);
+    void Touch(DiffusionSession* session);
+
+    static size_t EstimateWeightBytes(const std::string& resource_path);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Entry {
+        DiffusionSession* session;
+        // 0 while the session holds no weights
+        size_t bytes;
+        Clock::time_point last_used;
+    };
+    DiffusionResidency() = default;
+    ~DiffusionResidency();
+    void EvictLocked(DiffusionSession* keep, size_t incoming_bytes);
+    bool UnloadLocked(Entry& entry);
+    void IdleLoop();
+    std::list<Entry>::iterator FindLocked(DiffusionSession* session);
+
+    std::mutex mutex_;
+    std::condition_variable idle_cv_;
+    // front is the hottest session
+    std::list<Entry> entries_;
+    size_t budget_bytes_{0};
+    size_t resident_bytes_{0};
+    std::chrono::seconds idle_timeout_{0};
+    bool stopping_{false};
+    std::thread idle_thread_;
+};
+}
@@ -4,34 +4,519 @@
 //
 
 #include "diffusion_session.h"
+#include "diffusion_residency.h"
+#include "cpu_affinity.h"
 #include "mls_log.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <memory>
 #include <utility>
-mls::DiffusionSession::DiffusionSession(std::string resource_path, int memory_mode):
-                                        resource_path_(std::move(resource_path)),
-                                        memory_mode_(memory_mode){
-    this->diffusion_= std::make_unique<Diffusion>(
-            resource_path_,
-                          DiffusionModelType::STABLE_DIFFUSION_1_5,
-                          MNNForwardType::MNN_FORWARD_OPENCL,
-            memory_mode
-            );
-    MNN_DEBUG("diffusion session init resource_path_: %s memory_mode: %d ", resource_path_.c_str(), memory_mode);
+
+namespace {
+constexpr int kMemoryModeResident = 1;
+// step latency history, kept per weight set next to the weights
+constexpr const char* kLatencyFileName = "diffusion_latency.bin";
+
+bool ReadFileBytes(const std::string& path, std::vector<uint8_t>* data) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data->resize(size > 0 ? static_cast<size_t>(size) : 0);
+    bool ok = size > 0 && fread(data->data(), 1, data->size(), file) == data->size();
+    fclose(file);
+    return ok;
+}
+
+bool IsOpenCLAvailable() {
+    // same search order as MNN's OpenCL loader
+    static const char* kLibraries[] = {
+            "libOpenCL.so",
+            "libGLES_mali.so",
+            "libmali.so",
+            "libOpenCL-pixel.so",
+            "/system/vendor/lib64/libOpenCL.so",
+            "/system/lib64/libOpenCL.so",
+            "/vendor/lib64/libOpenCL.so",
+    };
+    for (const char* library : kLibraries) {
+        void* handle = dlopen(library, RTLD_NOW | RTLD_LOCAL);
+        if (handle) {
+            dlclose(handle);
+            return true;
+        }
+    }
+    return false;
+}
+
+MNNForwardType ResolveBackend(MNNForwardType requested) {
+    if (requested != MNNForwardType::MNN_FORWARD_OPENCL && requested != MNNForwardType::MNN_FORWARD_AUTO) {
+        return requested;
+    }
+    if (IsOpenCLAvailable()) {
+        return MNNForwardType::MNN_FORWARD_OPENCL;
+    }
+    if (requested == MNNForwardType::MNN_FORWARD_OPENCL) {
+        MNN_DEBUG("OpenCL driver not found, diffusion falls back to CPU");
+    }
+    return MNNForwardType::MNN_FORWARD_CPU;
+}
+
+bool FileExists(const std::string& path) {
+    return access(path.c_str(), R_OK) == 0;
+}
+
+// Links every file of |variant_path| plus the base files it does not override
+// into |overlay_path|, so the engine sees one complete model directory.
+bool BuildOverlay(const std::string& resource_path, const std::string& variant_path,
+                  const std::string& overlay_path) {
+    if (mkdir(overlay_path.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    for (const auto* source_dir : {&variant_path, &resource_path}) {
+        DIR* dir = opendir(source_dir->c_str());
+        if (!dir) {
+            return false;
+        }
+        while (auto* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            std::string source = *source_dir + "/" + name;
+            struct stat st{};
+            if (stat(source.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || name == kLatencyFileName) {
+                continue;
+            }
+            std::string link_path = overlay_path + "/" + name;
+            if (source_dir == &resource_path && FileExists(link_path)) {
+                // provided by the variant or linked by an earlier session
+                continue;
+            }
+            unlink(link_path.c_str());
+            if (symlink(source.c_str(), link_path.c_str()) != 0) {
+                // an incomplete overlay would fail to load instead of falling back
+                MNN_DEBUG("diffusion overlay link failed: %s errno: %d", link_path.c_str(), errno);
+                closedir(dir);
+                return false;
+            }
+        }
+        closedir(dir);
+    }
+    return true;
+}
+
+// A weight variant is a model directory under the resource path, e.g. a quantized
+// set or an adapter merged offline at a fixed scale ("lora/anime@0.8"). The engine
+// loads fixed file names from a single directory, so a variant that only ships the
+// modules it changes, or no tokenizer, is completed with the base files in an overlay of symlinks.
+std::string ResolveWeightVariant(const std::string& resource_path, const std::string& variant,
+                                 const std::string& overlay_dir) {
+    if (variant.empty()) {
+        return resource_path;
+    }
+    std::string variant_path = resource_path + "/" + variant;
+    bool complete = true;
+    bool any = false;
+    for (const char* module : {"text_encoder.mnn", "unet.mnn", "vae_decoder.mnn"}) {
+        bool exists = FileExists(variant_path + "/" + module);
+        complete = complete && exists;
+        any = any || exists;
+    }
+    // the engine also loads the tokenizer from the same directory: BPE (vocab.json +
+    // merges.txt) for CLIP models, WordPiece (vocab.txt) for Taiyi
+    bool has_tokenizer = (FileExists(variant_path + "/vocab.json") && FileExists(variant_path + "/merges.txt")) ||
+                         FileExists(variant_path + "/vocab.txt");
+    complete = complete && has_tokenizer;
+    if (complete) {
+        return variant_path;
+    }
+    if (!any || overlay_dir.empty()) {
+        MNN_DEBUG("diffusion weight variant %s unusable (overlay dir: %s), using base weights",
+                  variant.c_str(), overlay_dir.c_str());
+        return resource_path;
+    }
+    std::string name = variant;
+    std::replace(name.begin(), name.end(), '/', '_');
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "/%016llx_",
+             (unsigned long long)mls::HashBytes(reinterpret_cast<const uint8_t*>(resource_path.data()),
+                                           resource_path.size()));
+    std::string overlay_path = overlay_dir + prefix + name;
+    if (!BuildOverlay(resource_path, variant_path, overlay_path)) {
+        MNN_DEBUG("diffusion weight variant overlay failed: %s", overlay_path.c_str());
+        return resource_path;
+    }
+    return overlay_path;
+}
+
+}
+
+mls::DiffusionSession::DiffusionSession(std::string resource_path, const DiffusionSessionConfig& config):
+                                        resource_path_(ResolveWeightVariant(resource_path,
+                                                                            config.weight_variant,
+                                                                            config.overlay_dir)),
+                                        memory_mode_(config.memory_mode),
+                                        // GPU kernels are tuned per device and may change reduction order
+                                        // between runs, the CPU backend runs a fixed thread count with a
+                                        // fixed work split
+                                        backend_(config.deterministic ? MNNForwardType::MNN_FORWARD_CPU
+                                                                      : ResolveBackend(config.backend)){
+    if (!config.cpu_cores.empty()) {
+        cpu_cores_ = config.cpu_cores;
+    } else if (backend_ == MNNForwardType::MNN_FORWARD_CPU && config.cpu_big_cores) {
+        cpu_cores_ = GetBigCores();
+    }
+    auto& residency = DiffusionResidency::Instance();
+    if (memory_mode_ != kMemoryModeResident && residency.Budget() > 0) {
+        // the residency budget decides when weights go away, so keep them loaded after each run
+        memory_mode_ = kMemoryModeResident;
+    }
+    resident_ = memory_mode_ == kMemoryModeResident;
+    latency_model_ = std::make_unique<DiffusionLatencyModel>(resource_path_ + "/" + kLatencyFileName,
+                                                             (int)backend_, (int)cpu_cores_.size());
+    residency.Register(this);
+    // a variant or its overlay may not carry config.json, the base model describes the family
+    profile_ = DetectModelProfile(resource_path);
+    weight_bytes_ = DiffusionResidency::EstimateWeightBytes(resource_path_);
+    MNN_DEBUG("diffusion session init resource_path_: %s memory_mode: %d resident: %d weight_bytes: %zu "
+              "backend: %d pinned_cores: %zu model_family: %d default_steps: %d",
+              resource_path_.c_str(), memory_mode_, resident_, weight_bytes_, (int)backend_, cpu_cores_.size(),
+              (int)profile_.family, profile_.default_steps);
+    weight_files_ = WeightPrefetcher::ListWeightFiles(resource_path_);
+    if (config.lazy_load) {
+        prefetcher_.Start(weight_files_);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    Load();
+}
+
+mls::DiffusionSession::~DiffusionSession() {
+    DiffusionResidency::Instance().Unregister(this);
+    // the encoder flushes queued images before its thread exits
+}
+
+void mls::DiffusionSession::Load() {
+    if (resident_) {
+        DiffusionResidency::Instance().Acquire(this, weight_bytes_);
+    }
+    if (!diffusion_) {
+        this->diffusion_= std::make_unique<Diffusion>(
+                resource_path_,
+                              profile_.engine_type,
+                              backend_,
+                memory_mode_
+                );
+    }
+    // MNN spawns its CPU workers while loading, they inherit this thread's mask
+    ScopedCpuAffinity affinity(cpu_cores_);
     this->diffusion_->load();
     loaded_ = true;
 }
 
-void mls::DiffusionSession::Run(const std::string &prompt,
+bool mls::DiffusionSession::TryUnload() {
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return false;
+    }
+    diffusion_.reset();
+    loaded_ = false;
+    return true;
+}
+
+void mls::DiffusionSession::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // flushes images still queued for encoding before the thread goes away
+    encoder_.reset();
+    prefetcher_.Stop();
+    cancel_requested_ = false;
+    cancelled_ = false;
+    last_stats_ = DiffusionRunStats();
+}
+
+void mls::DiffusionSession::Cancel() {
+    cancel_requested_ = true;
+}
+
+void mls::DiffusionSession::SetProgressChannel(std::shared_ptr<DiffusionProgressChannel> channel) {
+    std::lock_guard<std::mutex> lock(progress_channel_mutex_);
+    progress_channel_ = std::move(channel);
+}
+
+bool mls::DiffusionSession::Run(const std::string &prompt,
                                 const std::string &image_path,
                                 int iter_num,
                                 int random_seed,
-                                const std::function<void(int)>& progressCallback) {
+                                const std::function<bool(int)>& progressCallback,
+                                const std::atomic<bool>* cancel_token,
+                                DiffusionRunInfo* run_info) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancel_requested_ = false;
+    cancelled_ = false;
+    bool success = RunLocked(prompt, image_path, iter_num, random_seed, progressCallback, cancel_token);
+    FillRunInfo(run_info);
+    return success;
+}
+
+bool mls::DiffusionSession::RunWithinLatency(const std::string& prompt,
+                                             const std::string& image_path,
+                                             int64_t target_latency_ms,
+                                             int max_steps,
+                                             int random_seed,
+                                             const std::function<bool(int)>& progressCallback,
+                                             DiffusionRunInfo* run_info) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancel_requested_ = false;
+    cancelled_ = false;
+    if (max_steps <= 0) {
+        max_steps = profile_.default_steps;
+    }
+    // below half the family default the images degrade faster than the latency drops
+    int min_steps = std::min(max_steps, std::max(1, profile_.default_steps / 2));
+    int iter_num = max_steps;
+    if (latency_model_->HasHistory()) {
+        iter_num = latency_model_->StepsForBudget(target_latency_ms, !loaded_, min_steps, max_steps);
+        if (iter_num == 0) {
+            MNN_DEBUG("diffusion latency target %lld ms out of reach, running %d steps",
+                      (long long)target_latency_ms, min_steps);
+            iter_num = min_steps;
+        }
+    }
+    MNN_DEBUG("diffusion latency target %lld ms: %d steps", (long long)target_latency_ms, iter_num);
+    bool success = RunLocked(prompt, image_path, iter_num, random_seed, progressCallback);
+    FillRunInfo(run_info);
+    return success;
+}
+
+bool mls::DiffusionSession::RunBatch(const std::string& prompt,
+                                     const std::vector<int>& random_seeds,
+                                     const std::vector<std::string>& image_paths,
+                                     int iter_num,
+                                     const std::function<bool(int, int)>& progressCallback,
+                                     const std::function<void(int, const std::string&)>& imageCallback,
+                                     DiffusionRunInfo* run_info) {
+    if (random_seeds.size() != image_paths.size()) {
+        return false;
+    }
+    // one lock for the whole batch, so queued jobs and eviction cannot interleave
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancel_requested_ = false;
+    cancelled_ = false;
+    // Outside resident mode the engine frees its modules at the end of every run. Use
+    // a resident engine for the batch instead, so the weights load once and go away
+    // when the batch ends.
+    int memory_mode = memory_mode_;
+    bool hold_weights = memory_mode_ != kMemoryModeResident && random_seeds.size() > 1;
+    if (hold_weights) {
+        diffusion_.reset();
+        loaded_ = false;
+        memory_mode_ = kMemoryModeResident;
+    }
+    bool success = true;
+    for (size_t i = 0; i < random_seeds.size() && success; ++i) {
+        int index = static_cast<int>(i);
+        success = RunLocked(prompt, image_paths[i], iter_num, random_seeds[i],
+                            [&progressCallback, index](int progress) {
+            return progressCallback && progressCallback(index, progress);
+        });
+        if (success && imageCallback) {
+            imageCallback(index, image_paths[i]);
+        }
+    }
+    if (hold_weights) {
+        memory_mode_ = memory_mode;
+        diffusion_.reset();
+        loaded_ = false;
+    }
+    FillRunInfo(run_info);
+    return success;
+}
+
+bool mls::DiffusionSession::RunLocked(const std::string& prompt,
+                                      const std::string& image_path,
+                                      int iter_num,
+                                      int random_seed,
+                                      const std::function<bool(int)>& progressCallback,
+                                      const std::atomic<bool>* cancel_token) {
+    auto cancel_pending = [this, cancel_token] {
+        return cancel_requested_ || (cancel_token && *cancel_token);
+    };
+    if (iter_num <= 0) {
+        iter_num = profile_.default_steps;
+    }
+    last_stats_ = DiffusionRunStats();
+    std::shared_ptr<DiffusionProgressChannel> channel;
+    {
+        std::lock_guard<std::mutex> lock(progress_channel_mutex_);
+        channel = progress_channel_;
+    }
+    auto run_start = std::chrono::steady_clock::now();
+    DiffusionProgress progress_state;
+    progress_state.total_steps = iter_num;
+    auto publish = [&channel, &progress_state, run_start](DiffusionStage stage, int64_t progress) {
+        if (!channel) {
+            return;
+        }
+        progress_state.stage = stage;
+        progress_state.progress = progress;
+        progress_state.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - run_start).count();
+        channel->Publish(progress_state, stage == DiffusionStage::kDone);
+    };
+    if (cancel_pending()) {
+        // cancelled between the images of a batch, or through the run's own token before it
+        // got the session: entry points clear cancel_requested_, never the token
+        cancelled_ = true;
+        return false;
+    }
+    // peak memory covers this run only, loading included
+    ScopedPeakRss peak_rss;
+    auto load_start = std::chrono::steady_clock::now();
+    const auto& history = latency_model_->Estimate();
+    // before the first step the whole prediction comes from earlier runs
+    int64_t steps_eta_ms = latency_model_->PredictRemainingMs(0, iter_num, 0);
     if (!loaded_) {
-        this->diffusion_->load();
-        loaded_ = true;
+        if (steps_eta_ms >= 0) {
+            progress_state.eta_ms = steps_eta_ms + static_cast<int64_t>(history.load_ms + history.text_encode_ms);
+        }
+        publish(DiffusionStage::kLoading, 0);
+        // the engine reads text encoder, UNet and VAE in that order, let the
+        // later files stream into the page cache while the earlier ones load and run
+        prefetcher_.Start(weight_files_);
+        Load();
+        last_stats_.load_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - load_start).count();
+    } else if (resident_) {
+        DiffusionResidency::Instance().Touch(this);
+    }
+    bool success = false;
+    ScopedCpuAffinity affinity(cpu_cores_);
+    DiffusionStageTimer timer;
+    timer.Start();
+    if (steps_eta_ms >= 0) {
+        progress_state.eta_ms = steps_eta_ms + static_cast<int64_t>(history.text_encode_ms);
+    }
+    publish(DiffusionStage::kTextEncode, 0);
+    // ticks: one after the text encoder, one per UNet step, one once the image is written
+    int ticks = 0;
+    auto unet_start = std::chrono::steady_clock::now();
+    // Throwing out of the hook would unwind through libdiffusion, which is not known
+    // to be exception safe, so a cancelled run is left to finish and discarded.
+    bool abandoned = false;
+    success = this->diffusion_->run(prompt, image_path, iter_num, random_seed,
+                                    [&](int progress) {
+        timer.Tick();
+        ++ticks;
+        if (abandoned) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (ticks == 1) {
+            unet_start = now;
+            progress_state.eta_ms = steps_eta_ms;
+            publish(DiffusionStage::kDenoise, progress);
+        } else if (ticks <= iter_num + 1) {
+            int step = ticks - 1;
+            auto unet_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - unet_start).count();
+            progress_state.step = step;
+            progress_state.eta_ms = latency_model_->PredictRemainingMs(step, iter_num, unet_ms);
+            publish(step == iter_num ? DiffusionStage::kDecode : DiffusionStage::kDenoise, progress);
+        } else {
+            progress_state.eta_ms = 0;
+            publish(DiffusionStage::kDone, progress);
+        }
+        bool final_tick = ticks > iter_num + 1;
+        if (progressCallback && progressCallback(progress) && !final_tick) {
+            cancel_requested_ = true;
+        }
+        // the final tick comes after the image is written, nothing is left to save
+        if (cancel_pending() && !final_tick) {
+            MNN_DEBUG("diffusion run cancelled, discarding it once the engine returns");
+            abandoned = true;
+        }
+    });
+    if (abandoned) {
+        cancelled_ = true;
+        remove(image_path.c_str());
     }
-    this->diffusion_->run(prompt, image_path, iter_num, random_seed, progressCallback);
-    if (memory_mode_ != 1) {
+    timer.Finish(&last_stats_);
+    last_stats_.peak_rss_kb = peak_rss.PeakKb();
+    if (success && !cancelled_) {
+        latency_model_->Record(last_stats_);
+    }
+    if (memory_mode_ != kMemoryModeResident) {
         loaded_ = false;
+    } else {
+        // idle time counts from the end of the run
+        DiffusionResidency::Instance().Touch(this);
+    }
+    if (success && !cancelled_) {
+        auto output_start = std::chrono::steady_clock::now();
+        std::vector<uint8_t> output;
+        if (ReadFileBytes(image_path, &output)) {
+            last_stats_.output_hash = HashBytes(output.data(), output.size());
+        }
+        last_stats_.output_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - output_start).count();
+    }
+    return success && !cancelled_;
+}
+
+bool mls::DiffusionSession::RunToPixels(const std::string& prompt,
+                                        const std::string& scratch_dir,
+                                        int iter_num,
+                                        int random_seed,
+                                        DiffusionImage* image,
+                                        const std::string& encode_path,
+                                        const std::function<bool(int)>& progressCallback,
+                                        DiffusionRunInfo* run_info) {
+    char name[64];
+    snprintf(name, sizeof(name), "/diffusion_%p.bmp", static_cast<void*>(this));
+    std::string scratch_path = scratch_dir + name;
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancel_requested_ = false;
+    cancelled_ = false;
+    bool success = RunLocked(prompt, scratch_path, iter_num, random_seed, progressCallback)
+                   && DecodeScratchLocked(scratch_path, image, encode_path);
+    remove(scratch_path.c_str());
+    FillRunInfo(run_info);
+    return success;
+}
+
+bool mls::DiffusionSession::DecodeScratchLocked(const std::string& scratch_path,
+                                                DiffusionImage* image,
+                                                const std::string& encode_path) {
+    auto output_start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> bmp;
+    bool ok = ReadFileBytes(scratch_path, &bmp);
+    // unlinked before writeback usually kicks in, so the pixels rarely reach storage
+    remove(scratch_path.c_str());
+    if (!ok || !DecodeBmpToRgba(bmp, image)) {
+        MNN_DEBUG("diffusion decode output failed: %s", scratch_path.c_str());
+        return false;
+    }
+    if (!encode_path.empty()) {
+        if (!encoder_) {
+            encoder_ = std::make_unique<DiffusionImageEncoder>();
+        }
+        encoder_->Enqueue(*image, encode_path);
+    }
+    last_stats_.output_us += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - output_start).count();
+    return true;
+}
+
+void mls::DiffusionSession::FillRunInfo(DiffusionRunInfo* run_info) const {
+    if (!run_info) {
+        return;
     }
+    run_info->cancelled = cancelled_;
+    run_info->stats = last_stats_;
 }
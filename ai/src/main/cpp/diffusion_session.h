@@ -4,22 +4,128 @@
 //
 
 #pragma once
+#include <atomic>
 #include <string>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include "diffusion/diffusion.hpp"
+#include "diffusion_image.h"
+#include "diffusion_latency.h"
+#include "diffusion_model_profile.h"
+#include "diffusion_prefetch.h"
+#include "diffusion_progress.h"
+#include "diffusion_stats.h"
 
 namespace mls {
+// What a run did, filled in before the run releases the session so concurrent
+// runs on the same session cannot mix up their results.
+struct DiffusionRunInfo {
+    bool cancelled{false};
+    // stage timings of the last image generated
+    DiffusionRunStats stats;
+};
+
+struct DiffusionSessionConfig {
+    int memory_mode{0};
+    // MNN_FORWARD_AUTO picks OpenCL when the driver can be loaded, CPU otherwise
+    MNNForwardType backend{MNNForwardType::MNN_FORWARD_OPENCL};
+    // keep CPU inference on the big cluster
+    bool cpu_big_cores{true};
+    // explicit CPU pinning, takes precedence over cpu_big_cores when not empty
+    std::vector<int> cpu_cores;
+    // defer load() to the first run and warm the page cache in the background meanwhile
+    bool lazy_load{false};
+    // repeatable output for A/B validation on the CPU backend
+    bool deterministic{false};
+    // weight set under the resource path: a quantized set such as "int8", or an
+    // adapter merged offline at a fixed scale such as "lora/anime@0.8"
+    std::string weight_variant;
+    // writable directory for completing variants that only ship the modules they change
+    std::string overlay_dir;
+};
+
 class DiffusionSession {
 public:
-    explicit DiffusionSession(std::string  resource_path, int memory_mode);
-    void Run(const std::string& prompt, const std::string& image_path,
+    explicit DiffusionSession(std::string  resource_path, const DiffusionSessionConfig& config);
+    ~DiffusionSession();
+    // iter_num <= 0 uses the detected model family's default step count.
+    // progressCallback returns true to cancel the run. The engine has no abort hook,
+    // so a run cancelled mid-way still finishes but its image is discarded, and a
+    // true from the final 100 tick, after the image is written, is ignored.
+    // |cancel_token|, when set, cancels this run only, unlike Cancel(). A token set
+    // before the run gets the session is honored before any weights are loaded.
+    // Returns false when the run was cancelled or the engine failed. |run_info| may be null.
+    bool Run(const std::string& prompt, const std::string& image_path,
              int iter_num,
-             int random_seed, const std::function<void(int)>& progressCallback);
+             int random_seed, const std::function<bool(int)>& progressCallback,
+             const std::atomic<bool>* cancel_token, DiffusionRunInfo* run_info);
+    // Picks the most steps, up to max_steps (<= 0 for the family default), that
+    // the latency history predicts finish within target_latency_ms, load included
+    // when the weights are not loaded. Without history it runs max_steps, which
+    // calibrates the next run.
+    bool RunWithinLatency(const std::string& prompt, const std::string& image_path,
+                          int64_t target_latency_ms, int max_steps,
+                          int random_seed, const std::function<bool(int)>& progressCallback,
+                          DiffusionRunInfo* run_info);
+    // Generates one image per seed, one after another, with the prompt, steps and
+    // weights shared across the batch: the weights load at most once per batch even
+    // outside resident mode. imageCallback fires as soon as each image is written, a
+    // failed or cancelled image stops the batch.
+    bool RunBatch(const std::string& prompt, const std::vector<int>& random_seeds,
+                  const std::vector<std::string>& image_paths, int iter_num,
+                  const std::function<bool(int index, int progress)>& progressCallback,
+                  const std::function<void(int index, const std::string& image_path)>& imageCallback,
+                  DiffusionRunInfo* run_info);
+    // Decodes the result straight into |image| instead of leaving an encoded file behind.
+    // The engine can only emit files, so it writes an uncompressed BMP under |scratch_dir|
+    // which is removed right after decoding. A non empty |encode_path| additionally
+    // gets a PNG/JPEG written on the encoder thread.
+    bool RunToPixels(const std::string& prompt, const std::string& scratch_dir,
+                     int iter_num, int random_seed, DiffusionImage* image,
+                     const std::string& encode_path,
+                     const std::function<bool(int)>& progressCallback,
+                     DiffusionRunInfo* run_info);
+    // Safe to call from any thread. Cancels the in-flight run as progressCallback
+    // returning true would, and keeps a batch from starting its next image.
+    void Cancel();
+    // Publishes stage, step and ETA of every run into |channel|, nullptr detaches it.
+    // Takes effect from the next run.
+    void SetProgressChannel(std::shared_ptr<DiffusionProgressChannel> channel);
+    const DiffusionModelProfile& ModelProfile() const { return profile_; }
+    // Drops the loaded weights unless a run is in flight, used by DiffusionResidency.
+    bool TryUnload();
+    // Returns the session to a fresh state without reloading: the encoder thread and
+    // per-run state go, loaded weights stay. Waits for an in-flight run.
+    void Reset();
 private:
+    void Load();
+    bool RunLocked(const std::string& prompt, const std::string& image_path, int iter_num,
+                   int random_seed, const std::function<bool(int)>& progressCallback,
+                   const std::atomic<bool>* cancel_token = nullptr);
+    bool DecodeScratchLocked(const std::string& scratch_path, DiffusionImage* image,
+                             const std::string& encode_path);
+    void FillRunInfo(DiffusionRunInfo* run_info) const;
     bool loaded_{false};
+    // weights stay loaded between runs until DiffusionResidency unloads them
+    bool resident_{false};
+    size_t weight_bytes_{0};
     std::string resource_path_;
+    DiffusionModelProfile profile_;
     int memory_mode_;
+    MNNForwardType backend_;
+    std::vector<int> cpu_cores_;
+    std::atomic<bool> cancel_requested_{false};
+    bool cancelled_{false};
+    std::unique_ptr<DiffusionImageEncoder> encoder_;
+    std::unique_ptr<DiffusionLatencyModel> latency_model_;
+    std::mutex progress_channel_mutex_;
+    std::shared_ptr<DiffusionProgressChannel> progress_channel_;
+    DiffusionRunStats last_stats_;
+    std::mutex mutex_;
+    std::vector<std::string> weight_files_;
+    WeightPrefetcher prefetcher_;
     std::unique_ptr<MNN::DIFFUSION::Diffusion> diffusion_{nullptr};
 };
 }
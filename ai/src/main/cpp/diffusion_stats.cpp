@@ -0,0 +1,110 @@
+//
+// Created on 2026/10/15.
+//
+
+#include "diffusion_stats.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+std::atomic<int> g_runs_in_flight{0};
+// bumped by every run start, tells a run whether another one started meanwhile
+std::atomic<uint64_t> g_run_starts{0};
+}
+
+uint64_t mls::HashBytes(const uint8_t* data, size_t size) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void mls::DiffusionStageTimer::Start() {
+    ticks_.clear();
+    start_ = Clock::now();
+}
+
+void mls::DiffusionStageTimer::Tick() {
+    ticks_.push_back(Clock::now());
+}
+
+void mls::DiffusionStageTimer::Finish(DiffusionRunStats* stats) const {
+    auto to_us = [](Clock::duration duration) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    };
+    if (ticks_.empty()) {
+        return;
+    }
+    stats->text_encode_us = to_us(ticks_.front() - start_);
+    if (ticks_.size() < 2) {
+        return;
+    }
+    stats->vae_decode_write_us = to_us(ticks_.back() - ticks_[ticks_.size() - 2]);
+    std::vector<int64_t> steps;
+    for (size_t i = 1; i + 1 < ticks_.size(); ++i) {
+        steps.push_back(to_us(ticks_[i] - ticks_[i - 1]));
+    }
+    if (steps.empty()) {
+        return;
+    }
+    int64_t total = 0;
+    for (auto step : steps) {
+        total += step;
+    }
+    std::sort(steps.begin(), steps.end());
+    stats->unet_steps = static_cast<int64_t>(steps.size());
+    stats->unet_total_us = total;
+    stats->step_min_us = steps.front();
+    stats->step_avg_us = total / stats->unet_steps;
+    stats->step_p95_us = steps[std::min(steps.size() - 1, (steps.size() * 95 + 99) / 100 - 1)];
+}
+
+int64_t mls::DiffusionStageTimer::ReadPeakRssKb() {
+    FILE* file = fopen("/proc/self/status", "r");
+    if (!file) {
+        return 0;
+    }
+    char line[256];
+    int64_t peak_kb = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            peak_kb = strtoll(line + 6, nullptr, 10);
+            break;
+        }
+    }
+    fclose(file);
+    return peak_kb;
+}
+
+bool mls::DiffusionStageTimer::ResetPeakRss() {
+    // writing 5 to clear_refs resets the peak, Linux 4.0 and later
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (!file) {
+        return false;
+    }
+    bool ok = fputs("5", file) >= 0;
+    return fclose(file) == 0 && ok;
+}
+
+mls::ScopedPeakRss::ScopedPeakRss() {
+    bool alone = g_runs_in_flight.fetch_add(1) == 0;
+    start_generation_ = g_run_starts.fetch_add(1) + 1;
+    // resetting under another run would wipe the peak it is measuring
+    exclusive_ = alone && DiffusionStageTimer::ResetPeakRss();
+}
+
+mls::ScopedPeakRss::~ScopedPeakRss() {
+    g_runs_in_flight.fetch_sub(1);
+}
+
+int64_t mls::ScopedPeakRss::PeakKb() const {
+    if (!exclusive_ || g_run_starts.load() != start_generation_) {
+        return 0;
+    }
+    return DiffusionStageTimer::ReadPeakRssKb();
+}
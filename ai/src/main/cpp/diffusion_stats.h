@@ -0,0 +1,69 @@
+//
+// Created on 2026/10/15.
+//
+
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mls {
+struct DiffusionRunStats {
+    int64_t load_us{0};
+    int64_t text_encode_us{0};
+    int64_t unet_steps{0};
+    int64_t unet_total_us{0};
+    int64_t step_min_us{0};
+    int64_t step_avg_us{0};
+    int64_t step_p95_us{0};
+    // the engine decodes and writes the image in one go
+    int64_t vae_decode_write_us{0};
+    // reading back / decoding / caching the output after the engine returns
+    int64_t output_us{0};
+    // Process peak over this run, VmHWM is reset when it starts. The peak covers the
+    // whole process, LLM allocations made meanwhile included, and the reset also
+    // clears the peak other components read. 0 when another diffusion run overlapped
+    // this one or the kernel refused the reset.
+    int64_t peak_rss_kb{0};
+    // FNV-1a over the encoded output, equal hashes mean bit identical images
+    uint64_t output_hash{0};
+};
+
+uint64_t HashBytes(const uint8_t* data, size_t size);
+
+// Derives stage timings from the engine's progress ticks: one after the text
+// encoder, one per UNet step and a final one once the image is written.
+class DiffusionStageTimer {
+public:
+    void Start();
+    void Tick();
+    // fills everything except load_us, output_us and peak_rss_kb
+    void Finish(DiffusionRunStats* stats) const;
+
+    static int64_t ReadPeakRssKb();
+    // VmHWM only grows, restarts it from the current RSS
+    static bool ResetPeakRss();
+
+private:
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start_;
+    std::vector<Clock::time_point> ticks_;
+};
+
+// Attributes the process peak RSS to one diffusion run. VmHWM is process wide, so
+// it is only reset and reported when no other diffusion run is in flight.
+class ScopedPeakRss {
+public:
+    ScopedPeakRss();
+    ~ScopedPeakRss();
+    ScopedPeakRss(const ScopedPeakRss&) = delete;
+    ScopedPeakRss& operator=(const ScopedPeakRss&) = delete;
+    // 0 when another run overlapped this one or the reset failed
+    int64_t PeakKb() const;
+
+private:
+    bool exclusive_{false};
+    uint64_t start_generation_{0};
+};
+}
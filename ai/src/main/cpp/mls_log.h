@@ -3,8 +3,16 @@
 //
 
 #pragma once
+#ifdef __ANDROID__
 #include <android/log.h>
 #define LOG_TAG "MNN_DEBUG"
 #define MNN_DEBUG(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
 #define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
\ No newline at end of file
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+// host builds such as the diffusion benchmark log to stderr
+#include <cstdio>
+#define MNN_DEBUG(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#define LOGD(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#define LOGE(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
\ No newline at end of file